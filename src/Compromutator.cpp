@@ -3,17 +3,22 @@
 #include <chrono>
 
 Compromutator::Compromutator(ProxySettings settings,
-                             uint32_t timeout_duration,
-                             std::string measurement_filename):
+                             uint32_t max_latency,
+                             std::string measurement_filename,
+                             uint32_t worker_number,
+                             uint32_t shard_number):
     is_running_(false),
     alarm_(std::make_shared<Alarm>(
-        std::chrono::milliseconds(timeout_duration))),
+        std::chrono::milliseconds(max_latency))),
     proxy_(settings, alarm_),
-    controller_(alarm_, proxy_.getSender(), measurement_filename),
-    pipeline_(proxy_.getSender(), controller_)
+    controller_(alarm_, proxy_.getSender(), measurement_filename,
+                worker_number),
+    pipeline_(proxy_.getSender(), controller_, shard_number)
 {
-    std::cout<<"Timeout: "<<timeout_duration<<std::endl;
+    std::cout<<"Max latency: "<<max_latency<<std::endl;
     std::cout<<"Measurements: "<<measurement_filename<<std::endl;
+    std::cout<<"Workers: "<<worker_number<<std::endl;
+    std::cout<<"Pipeline shards: "<<shard_number<<std::endl;
 }
 
 Compromutator::~Compromutator()
@@ -21,33 +26,55 @@ Compromutator::~Compromutator()
     is_running_ = false;
 }
 
+void Compromutator::stop()
+{
+    is_running_ = false;
+    alarm_->notify();
+}
+
 void Compromutator::run()
 {
     is_running_ = true;
     while (is_running_) {
-        //auto status = alarm_->wait(std::chrono::milliseconds(10));
+        // Ticks fire only when the detector has work or messages are
+        // queued in the pipeline
         auto status = alarm_->wait();
         if (status == Alarm::Status::TIMEOUT) {
-            pipeline_.addBarrier();
-            controller_.detector.prepareInstructions();
+            // Instructions are prepared after every pipeline shard has
+            // handled the messages received before the tick
+            pipeline_.addBarrier([this]() {
+                controller_.detector.prepareInstructions();
+            });
         }
         else {
-            if (controller_.detector.instructionsExist()) {
-                pipeline_.flushPipeline();
-                handle_detector_instruction();
-            }
-            if (proxy_.eventsExist()) {
-                handle_proxy_event();
-            }
+            // Queues notify once until they are drained, so both of them
+            // are drained on every notification
+            handle_detector_instruction();
+            handle_proxy_event();
         }
     }
+    shutdown();
+}
+
+void Compromutator::shutdown()
+{
+    // Let the pipeline hand the received messages to the detector and the
+    // detector finish the submitted tasks, so that the pending measurements
+    // are filled before they are written
+    pipeline_.stop();
+    controller_.detector.stop();
+    handle_detector_instruction();
+    controller_.performance_monitor.flush();
+    std::cout<<"Stopped"<<std::endl;
 }
 
 void Compromutator::handle_detector_instruction()
 {
     // TODO: implement instruction handling
-    while (controller_.detector.instructionsExist()) {
-        auto instruction = controller_.detector.getInstruction();
+    controller_.detector.popInstructions(instructions_);
+    for (auto& instruction : instructions_) {
+        // Every instruction releases the messages before its barrier
+        pipeline_.flushPipeline();
 
         std::unordered_set<SwitchId> requested_switches;
         for (const auto& request : instruction.requests.data) {
@@ -55,7 +82,7 @@ void Compromutator::handle_detector_instruction()
             if (auto rule_request = RuleRequest::pointerCast(request)) {
                 requested_switches.insert(rule_request->rule->switch_id);
                 controller_.stats_manager.getRuleStats(
-                    request_id, rule_request->rule);
+                    request_id, rule_request->rule, rule_request->cookie_mask);
             }
             else {
                 assert(0);
@@ -101,12 +128,13 @@ void Compromutator::handle_detector_instruction()
         //DEBUG//    std::cout<<"------ Add: "<<*rule_to_add<<std::endl;
         //DEBUG//}
     }
+    instructions_.clear();
 }
 
 void Compromutator::handle_proxy_event()
 {
-    while (proxy_.eventsExist()) {
-        auto event = proxy_.getEvent();
+    proxy_.popEvents(events_);
+    for (const auto& event : events_) {
         switch (event->type) {
         case EventType::CONNECTION: {
             auto connection_event = ConnectionEvent::pointerCast(event);
@@ -125,4 +153,5 @@ void Compromutator::handle_proxy_event()
         }
         }
     }
+    events_.clear();
 }
@@ -17,16 +17,21 @@
 
 #include <atomic>
 #include <memory>
+#include <vector>
 
 class Compromutator
 {
 public:
-    explicit Compromutator(ProxySettings settings,
-                           uint32_t timeout_duration,
-                           std::string measurement_filename);
+    Compromutator(ProxySettings settings,
+                  uint32_t max_latency,
+                  std::string measurement_filename,
+                  uint32_t worker_number = 0,
+                  uint32_t shard_number = 0);
     ~Compromutator();
 
     void run();
+    // Makes run() return, safe to call from a signal handler
+    void stop();
 
 private:
     std::atomic_bool is_running_;
@@ -36,6 +41,11 @@ private:
     Controller controller_;
     pipeline::Pipeline pipeline_;
 
+    // Drained queue items, reused between notifications
+    std::vector<Instruction> instructions_;
+    std::vector<EventPtr> events_;
+
+    void shutdown();
     void handle_detector_instruction();
     void handle_proxy_event();
 };
@@ -1,168 +1,883 @@
 #pragma once
 
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <algorithm>
 #include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <chrono>
 #include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
 #include <functional>
+#include <iterator>
 #include <memory>
 #include <mutex>
+#include <new>
+#include <system_error>
 #include <thread>
+#include <type_traits>
+#include <utility>
 #include <queue>
+#include <vector>
 
+// Wakes up the main loop. Notifications wake it up at once, while ticks
+// fire on a deadline that is armed only when the detector has work, at most
+// max_latency after the work appears.
 class Alarm
 {
+    using Clock = std::chrono::steady_clock;
+
 public:
     enum class Status {
         NO_TIMEOUT,
         TIMEOUT
     };
 
-    explicit Alarm(std::chrono::milliseconds timeout_duration):
-        timeout_duration_(timeout_duration),
-        remaining_time_(timeout_duration) {}
+    explicit Alarm(std::chrono::milliseconds max_latency):
+        max_latency_(max_latency), is_armed_(false),
+        event_fd_(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)),
+        timer_fd_(timerfd_create(CLOCK_MONOTONIC,
+                                 TFD_CLOEXEC | TFD_NONBLOCK))
+    {
+        if (-1 == event_fd_ || -1 == timer_fd_) {
+            throw std::system_error(errno, std::generic_category(),
+                                    "Alarm creation failed");
+        }
+    }
+    Alarm(const Alarm&) = delete;
+    Alarm& operator=(const Alarm&) = delete;
+
+    ~Alarm() {
+        close(event_fd_);
+        close(timer_fd_);
+    }
 
     void notify() {
-        alarm_.notify_one();
+        uint64_t value = 1u;
+        (void)!write(event_fd_, &value, sizeof(value));
     }
 
-    //Status wait(std::chrono::milliseconds timeout_duration) {
-    //    std::unique_lock<std::mutex> wait_lock(mutex_);
-    //    auto status = alarm_.wait_for(wait_lock, timeout_duration);
-    //    return std::cv_status::no_timeout == status
-    //           ? Status::NO_TIMEOUT
-    //           : Status::TIMEOUT;
-    //}
-    Status wait() {
-        std::unique_lock<std::mutex> wait_lock(mutex_);
+    void scheduleTick() {
+        arm(max_latency_);
+    }
 
-        auto start_time = std::chrono::high_resolution_clock::now();
-        auto status = alarm_.wait_for(wait_lock, remaining_time_);
-        auto finish_time = std::chrono::high_resolution_clock::now();
-        auto duration = std::chrono::duration_cast<
-            std::chrono::milliseconds
-        >(finish_time - start_time);
+    // The tick fires without waiting for the deadline
+    void expire() {
+        arm(std::chrono::milliseconds(0));
+    }
 
-        if (std::cv_status::timeout == status) {
-            remaining_time_ = timeout_duration_;
-            return Status::TIMEOUT;
-        }
-        else {
-            if (duration < remaining_time_) {
-                remaining_time_ -= duration;
-            }
-            else {
-                remaining_time_ = timeout_duration_;
+    Status wait() {
+        pollfd fds[] = {{timer_fd_, POLLIN, 0}, {event_fd_, POLLIN, 0}};
+        while (poll(fds, 2, -1) < 0) {
+            if (EINTR != errno) {
+                throw std::system_error(errno, std::generic_category(),
+                                        "Alarm wait failed");
             }
-            return Status::NO_TIMEOUT;
         }
+
+        // Ticks go first, pending notifications are returned by the next
+        // wait
+        uint64_t value;
+        if (fds[0].revents & POLLIN) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            (void)!read(timer_fd_, &value, sizeof(value));
+            is_armed_ = false;
+            return Status::TIMEOUT;
+        }
+        (void)!read(event_fd_, &value, sizeof(value));
+        return Status::NO_TIMEOUT;
     }
 
 private:
+    std::chrono::milliseconds max_latency_;
     std::mutex mutex_;
-    std::condition_variable alarm_;
-    std::chrono::milliseconds timeout_duration_;
-    std::chrono::milliseconds remaining_time_;
+    bool is_armed_;
+    Clock::time_point deadline_;
+    int event_fd_;
+    int timer_fd_;
+
+    void arm(std::chrono::milliseconds delay) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto deadline = Clock::now() + delay;
+        if (is_armed_ && deadline_ <= deadline) {
+            return;
+        }
+        is_armed_ = true;
+        deadline_ = deadline;
+
+        // Zero value disarms the timer, so the shortest delay is 1ns
+        auto nanoseconds = std::max<int64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(delay)
+                .count(), 1
+        );
+        itimerspec timer_spec{};
+        timer_spec.it_value.tv_sec = nanoseconds / 1000000000;
+        timer_spec.it_value.tv_nsec = nanoseconds % 1000000000;
+        timerfd_settime(timer_fd_, 0, &timer_spec, nullptr);
+    }
 
 };
 
+// Bounded lock-free queue of many producers and one consumer. Producers
+// wait for a free cell while the queue is full. Pushes notify the alarm
+// once until the consumer drains the queue with popAll().
 template <class Item>
 class ConcurrentAlarmingQueue
 {
+    struct Cell {
+        std::atomic<size_t> sequence;
+        Item item;
+    };
+
 public:
-    explicit ConcurrentAlarmingQueue(std::shared_ptr<Alarm> alarm):
-        alarm_(alarm) {}
+    static constexpr size_t DEFAULT_CAPACITY = 1u << 16;
 
-    bool empty() {
-        std::lock_guard<std::mutex> lock(mutex_);
-        return items_.empty();
+    explicit ConcurrentAlarmingQueue(std::shared_ptr<Alarm> alarm,
+                                     size_t capacity = DEFAULT_CAPACITY):
+        alarm_(alarm), head_(0), tail_(0), is_notified_(false) {
+        size_t cell_number = 1u;
+        while (cell_number < capacity) cell_number <<= 1;
+        mask_ = cell_number - 1;
+        cells_ = std::make_unique<Cell[]>(cell_number);
+        for (size_t i = 0; i < cell_number; i++) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
     }
 
-    size_t size() {
-        std::lock_guard<std::mutex> lock(mutex_);
-        return items_.size();
+    bool empty() const {
+        auto head = head_.load(std::memory_order_relaxed);
+        return not is_ready(cells_[head & mask_], head);
+    }
+
+    size_t size() const {
+        return tail_.load(std::memory_order_relaxed) -
+               head_.load(std::memory_order_relaxed);
     }
 
     void push(Item&& item) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        items_.push(std::move(item));
-        alarm_->notify();
+        auto position = tail_.load(std::memory_order_relaxed);
+        while (true) {
+            auto& cell = cells_[position & mask_];
+            auto sequence = cell.sequence.load(std::memory_order_acquire);
+            auto difference = (intptr_t)sequence - (intptr_t)position;
+            if (0 == difference) {
+                if (tail_.compare_exchange_weak(position, position + 1,
+                                                std::memory_order_relaxed)) {
+                    cell.item = std::move(item);
+                    cell.sequence.store(position + 1,
+                                        std::memory_order_release);
+                    break;
+                }
+            }
+            else {
+                if (difference < 0) {
+                    // The queue is full
+                    std::this_thread::yield();
+                }
+                position = tail_.load(std::memory_order_relaxed);
+            }
+        }
+
+        if (not is_notified_.exchange(true)) {
+            alarm_->notify();
+        }
     }
 
-    Item pop() {
-        std::lock_guard<std::mutex> lock(mutex_);
-        Item item = std::move(items_.front());
-        items_.pop();
-        return item;
+    // Moves all items to the vector and returns their number, the consumer
+    // must call it after each alarm notification
+    size_t popAll(std::vector<Item>& items) {
+        is_notified_.store(false);
+        size_t item_number = 0u;
+        auto head = head_.load(std::memory_order_relaxed);
+        while (is_ready(cells_[head & mask_], head)) {
+            auto& cell = cells_[head & mask_];
+            items.push_back(std::move(cell.item));
+            cell.item = Item();
+            cell.sequence.store(head + mask_ + 1, std::memory_order_release);
+            head_.store(++head, std::memory_order_relaxed);
+            item_number++;
+        }
+        return item_number;
     }
 
 private:
-    std::mutex mutex_;
     std::shared_ptr<Alarm> alarm_;
-    std::queue<Item> items_;
+    std::unique_ptr<Cell[]> cells_;
+    size_t mask_;
+
+    std::atomic<size_t> head_;
+    std::atomic<size_t> tail_;
+    std::atomic_bool is_notified_;
+
+    static bool is_ready(const Cell& cell, size_t head) {
+        return head + 1 == cell.sequence.load(std::memory_order_acquire);
+    }
 
 };
 
-template <class Item>
-class ConcurrentQueue
+// Move-only callable that stores small closures inline, so submitting a
+// detector call does not allocate
+class Task
 {
+    // Fits closures that capture a RuleInfo
+    static constexpr size_t BUFFER_SIZE = 192;
+
+    struct Operations {
+        void (*call)(void* function);
+        void (*move)(void* to, void* from);
+        void (*destroy)(void* function);
+    };
+
+    template<class Function, bool IS_INLINE>
+    struct Storage;
+
+    template<class Function>
+    struct Storage<Function, true> {
+        static Function& get(void* buffer) {
+            return *static_cast<Function*>(buffer);
+        }
+        static void create(void* buffer, Function&& function) {
+            new (buffer) Function(std::move(function));
+        }
+        static void move(void* to, void* from) {
+            new (to) Function(std::move(get(from)));
+            get(from).~Function();
+        }
+        static void destroy(void* buffer) {
+            get(buffer).~Function();
+        }
+    };
+
+    template<class Function>
+    struct Storage<Function, false> {
+        static Function& get(void* buffer) {
+            return **static_cast<Function**>(buffer);
+        }
+        static void create(void* buffer, Function&& function) {
+            *static_cast<Function**>(buffer) =
+                new Function(std::move(function));
+        }
+        static void move(void* to, void* from) {
+            *static_cast<Function**>(to) = *static_cast<Function**>(from);
+        }
+        static void destroy(void* buffer) {
+            delete *static_cast<Function**>(buffer);
+        }
+    };
+
+    template<class Function>
+    using StorageFor = Storage<Function,
+        sizeof(Function) <= BUFFER_SIZE &&
+        alignof(Function) <= alignof(std::max_align_t) &&
+        std::is_nothrow_move_constructible<Function>::value>;
+
+    template<class Function>
+    static const Operations* operations() {
+        static const Operations operations = {
+            [](void* function) {StorageFor<Function>::get(function)();},
+            &StorageFor<Function>::move,
+            &StorageFor<Function>::destroy
+        };
+        return &operations;
+    }
+
 public:
-    bool empty() {
-        std::lock_guard<std::mutex> lock(mutex_);
-        return items_.empty();
+    Task(): operations_(nullptr) {}
+
+    template<class Function, class = std::enable_if_t<
+        not std::is_same<std::decay_t<Function>, Task>::value>>
+    Task(Function&& function):
+        operations_(operations<std::decay_t<Function>>()) {
+        using Decayed = std::decay_t<Function>;
+        StorageFor<Decayed>::create(&buffer_,
+                                    Decayed(std::forward<Function>(function)));
     }
 
-    void push(Item&& item) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        items_.push(std::move(item));
-        non_empty_.notify_one();
+    Task(Task&& other) noexcept: operations_(other.operations_) {
+        if (operations_) {
+            operations_->move(&buffer_, &other.buffer_);
+            other.operations_ = nullptr;
+        }
     }
 
-    Item pop() {
-        std::unique_lock<std::mutex> lock(mutex_);
-        if (items_.empty()) {
-            non_empty_.wait(lock);
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            reset();
+            operations_ = other.operations_;
+            if (operations_) {
+                operations_->move(&buffer_, &other.buffer_);
+                other.operations_ = nullptr;
+            }
         }
-        Item item = std::move(items_.front());
-        items_.pop();
-        return item;
+        return *this;
     }
 
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task() {reset();}
+
+    explicit operator bool() const {return nullptr != operations_;}
+    void operator()() {operations_->call(&buffer_);}
+
 private:
-    std::mutex mutex_;
-    std::condition_variable non_empty_;
-    std::queue<Item> items_;
+    std::aligned_storage_t<BUFFER_SIZE, alignof(std::max_align_t)> buffer_;
+    const Operations* operations_;
 
+    void reset() {
+        if (operations_) {
+            operations_->destroy(&buffer_);
+            operations_ = nullptr;
+        }
+    }
 };
 
+// Runs tasks in one thread. Submitted tasks are drained in batches, one
+// lock acquisition per batch. Tasks that are added after stop() are
+// discarded.
+//
+// Tasks of a higher priority overtake the waiting tasks of lower ones, while
+// tasks of one priority run in the order of submission. Fences are never
+// reordered: they run after every earlier task and before every later one.
 class Executor
 {
+    using Clock = std::chrono::steady_clock;
+
 public:
-    using Task = std::function<void(void)>;
+    using Duration = std::chrono::microseconds;
+
+    enum class StopPolicy {
+        DRAIN,  // Run the outstanding tasks before stopping
+        DROP    // Discard the outstanding tasks
+    };
+
+    enum class Priority {
+        HIGH,
+        NORMAL,
+        LOW
+    };
+
+private:
+    static constexpr size_t PRIORITY_NUMBER = 3;
+    // A lower priority task runs after this number of overtaking tasks
+    static constexpr size_t MAX_OVERTAKES = 64;
 
-    Executor(): is_running_(true) {
+    struct QueuedTask {
+        Task task;
+        Clock::time_point submit_time;
+        Priority priority;
+        bool is_fence;
+        uint64_t sequence;
+    };
+
+public:
+    Executor(): stop_policy_(StopPolicy::DRAIN), is_stopped_(false),
+                is_dropping_(false), has_urgent_tasks_(false), next_sequence_(0), overtakes_(0),
+                queue_depth_(0), executed_tasks_(0),
+                task_latency_(0), max_task_latency_(0) {
+        for (auto& latency : max_priority_latency_) {
+            latency = 0;
+        }
         thread_ = std::thread([this]() {
             this->run();
         });
-        thread_.detach();
     }
 
+    Executor(const Executor&) = delete;
+    Executor& operator=(const Executor&) = delete;
+
     ~Executor() {
-        is_running_ = false;
-        thread_.join();
+        // The thread still runs the task that would destroy the executor
+        assert(std::this_thread::get_id() != thread_.get_id());
+        stop();
+    }
+
+    // Wakes the thread up and waits for it to finish. A task may stop its
+    // own executor, then the thread finishes after the task returns and is
+    // joined by the destructor
+    void stop(StopPolicy policy = StopPolicy::DRAIN) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (not is_stopped_) {
+                is_stopped_ = true;
+                stop_policy_ = policy;
+                is_dropping_ = StopPolicy::DROP == policy;
+            }
+        }
+        has_tasks_.notify_one();
+        if (thread_.joinable() &&
+                std::this_thread::get_id() != thread_.get_id()) {
+            thread_.join();
+        }
+    }
+
+    void addTask(Task&& task, Priority priority = Priority::NORMAL) {
+        add_tasks(&task, &task + 1, priority, false);
+    }
+
+    void addTasks(std::vector<Task>&& tasks,
+                  Priority priority = Priority::NORMAL) {
+        add_tasks(tasks.data(), tasks.data() + tasks.size(), priority, false);
+        tasks.clear();
     }
 
-    void addTask(Task&& task) {
-        tasks_.push(std::move(task));
+    void addFence(Task&& task) {
+        add_tasks(&task, &task + 1, Priority::NORMAL, true);
+    }
+
+    // Tasks that are submitted but not finished
+    size_t queueDepth() const {return queue_depth_;}
+    uint64_t executedTasks() const {return executed_tasks_;}
+    // Time between submission and start of the running or the last task
+    Duration taskLatency() const {return Duration(task_latency_);}
+    Duration maxTaskLatency() const {return Duration(max_task_latency_);}
+    Duration maxTaskLatency(Priority priority) const {
+        return Duration(max_priority_latency_[(size_t)priority]);
     }
 
 private:
     std::thread thread_;
-    ConcurrentQueue<Task> tasks_;
-    std::atomic_bool is_running_;
+    std::mutex mutex_;
+    std::condition_variable has_tasks_;
+    std::vector<QueuedTask> tasks_;
+    StopPolicy stop_policy_;
+    bool is_stopped_;
+    std::atomic_bool is_dropping_;
+    std::atomic_bool has_urgent_tasks_;
+
+    // Owned by the executor thread. Tasks before the first fence wait in
+    // the queues of their priorities, the rest wait in the fenced queue.
+    std::deque<QueuedTask> priority_queues_[PRIORITY_NUMBER];
+    std::deque<QueuedTask> fenced_tasks_;
+    uint64_t next_sequence_;
+    size_t overtakes_;
+
+    std::atomic<size_t> queue_depth_;
+    std::atomic<uint64_t> executed_tasks_;
+    std::atomic<Duration::rep> task_latency_;
+    std::atomic<Duration::rep> max_task_latency_;
+    std::atomic<Duration::rep> max_priority_latency_[PRIORITY_NUMBER];
+
+    void add_tasks(Task* first, Task* last, Priority priority,
+                   bool is_fence) {
+        if (first == last) return;
+        auto submit_time = Clock::now();
+        bool was_empty;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (is_stopped_) return;
+            was_empty = tasks_.empty();
+            for (auto task = first; task != last; task++) {
+                tasks_.push_back({std::move(*task), submit_time,
+                                  priority, is_fence, 0u});
+            }
+        }
+        queue_depth_ += last - first;
+        if (Priority::HIGH == priority) {
+            has_urgent_tasks_ = true;
+        }
+        if (was_empty) {
+            has_tasks_.notify_one();
+        }
+    }
+
+    bool queues_empty() const {
+        for (const auto& queue : priority_queues_) {
+            if (not queue.empty()) return false;
+        }
+        return true;
+    }
+
+    void enqueue(QueuedTask&& queued_task) {
+        queued_task.sequence = next_sequence_++;
+        if (queued_task.is_fence || not fenced_tasks_.empty()) {
+            fenced_tasks_.push_back(std::move(queued_task));
+        }
+        else {
+            auto priority = (size_t)queued_task.priority;
+            priority_queues_[priority].push_back(std::move(queued_task));
+        }
+    }
+
+    // Returns false if the executor must stop
+    bool fetch(bool wait) {
+        std::vector<QueuedTask> batch;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (wait) {
+                has_tasks_.wait(lock, [this]() {
+                    return is_stopped_ || not tasks_.empty();
+                });
+                if (is_stopped_ && (tasks_.empty() ||
+                                    StopPolicy::DROP == stop_policy_)) {
+                    queue_depth_ -= tasks_.size();
+                    tasks_.clear();
+                    return false;
+                }
+            }
+            std::swap(batch, tasks_);
+        }
+        for (auto& queued_task : batch) {
+            enqueue(std::move(queued_task));
+        }
+        return true;
+    }
+
+    // Moves the tasks between the first two fences to the priority queues
+    void pass_fence() {
+        auto fence = std::move(fenced_tasks_.front());
+        fenced_tasks_.pop_front();
+        execute(fence);
+        while (not fenced_tasks_.empty() &&
+               not fenced_tasks_.front().is_fence) {
+            auto& queued_task = fenced_tasks_.front();
+            auto priority = (size_t)queued_task.priority;
+            priority_queues_[priority].push_back(std::move(queued_task));
+            fenced_tasks_.pop_front();
+        }
+    }
+
+    std::deque<QueuedTask>& next_queue() {
+        auto first = std::find_if(
+            std::begin(priority_queues_), std::end(priority_queues_),
+            [](const std::deque<QueuedTask>& queue) {return not queue.empty();}
+        );
+        auto oldest = first;
+        for (auto it = first; it != std::end(priority_queues_); it++) {
+            if (not it->empty() &&
+                    it->front().sequence < oldest->front().sequence) {
+                oldest = it;
+            }
+        }
+        if (oldest == first) {
+            overtakes_ = 0;
+            return *first;
+        }
+        if (++overtakes_ > MAX_OVERTAKES) {
+            overtakes_ = 0;
+            return *oldest;
+        }
+        return *first;
+    }
+
+    void execute(QueuedTask& queued_task) {
+        auto latency = std::chrono::duration_cast<Duration>(
+            Clock::now() - queued_task.submit_time
+        ).count();
+        task_latency_ = latency;
+        if (latency > max_task_latency_) {
+            max_task_latency_ = latency;
+        }
+        auto& priority_latency =
+            max_priority_latency_[(size_t)queued_task.priority];
+        if (latency > priority_latency) {
+            priority_latency = latency;
+        }
+
+        queued_task.task();
+        executed_tasks_++;
+        queue_depth_--;
+    }
+
+    void drop_queued_tasks() {
+        for (auto& queue : priority_queues_) {
+            queue_depth_ -= queue.size();
+            queue.clear();
+        }
+        queue_depth_ -= fenced_tasks_.size();
+        fenced_tasks_.clear();
+    }
 
     void run() {
-        while (is_running_) {
-            auto task = tasks_.pop();
-            task();
+        while (true) {
+            if (is_dropping_) {
+                drop_queued_tasks();
+            }
+
+            if (not queues_empty()) {
+                auto& queue = next_queue();
+                auto queued_task = std::move(queue.front());
+                queue.pop_front();
+                execute(queued_task);
+
+                // Urgent tasks are fetched without waiting for the batch
+                if (has_urgent_tasks_.exchange(false)) {
+                    fetch(false);
+                }
+            }
+            else if (not fenced_tasks_.empty()) {
+                pass_fence();
+            }
+            else if (not fetch(true)) {
+                return;
+            }
         }
     }
 };
+
+class TaskGroup;
+
+// Runs tasks on a fixed number of workers. Every worker owns a deque, takes
+// its newest tasks and steals the oldest tasks of the others. Tasks are
+// forked and joined with TaskGroup.
+class WorkStealingPool
+{
+    struct TaskDeque {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+public:
+    // Deque 0 belongs to the threads that join tasks without being workers,
+    // every worker owns one of the remaining deques
+    explicit WorkStealingPool(size_t worker_number):
+        is_running_(true), pending_tasks_(0), next_deque_(0) {
+        for (size_t i = 0; i < worker_number + 1; i++) {
+            deques_.emplace_back(std::make_unique<TaskDeque>());
+        }
+        for (size_t i = 1; i < worker_number + 1; i++) {
+            workers_.emplace_back([this, i]() {
+                this->run(i);
+            });
+        }
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            is_running_ = false;
+        }
+        has_tasks_.notify_all();
+        for (auto& worker : workers_) {
+            worker.join();
+        }
+    }
+
+    // One worker per hardware thread, the joining thread is not counted
+    static size_t defaultWorkerNumber() {
+        return std::max(std::thread::hardware_concurrency(), 1u) - 1u;
+    }
+
+    size_t workerNumber() const {return workers_.size();}
+
+    // Calls body(begin, end) on chunks of [0, size) and returns when every
+    // chunk is processed. The calling thread executes tasks while it waits.
+    template<class Body>
+    void parallelFor(size_t size, size_t grain_size, const Body& body);
+
+private:
+    friend class TaskGroup;
+
+    std::vector<std::unique_ptr<TaskDeque>> deques_;
+    std::vector<std::thread> workers_;
+
+    std::mutex mutex_;
+    std::condition_variable has_tasks_;
+    bool is_running_;
+    std::atomic<size_t> pending_tasks_;
+    std::atomic<size_t> next_deque_;
+
+    static const WorkStealingPool*& current_pool() {
+        static thread_local const WorkStealingPool* pool = nullptr;
+        return pool;
+    }
+
+    static size_t& current_deque() {
+        static thread_local size_t deque = 0;
+        return deque;
+    }
+
+    size_t home_deque() const {
+        return this == current_pool() ? current_deque() : 0u;
+    }
+
+    void push(Task&& task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_tasks_++;
+        }
+        // Workers keep the tasks they fork, other threads spread them
+        auto home = home_deque();
+        auto& deque = 0u != home ?
+            *deques_[home] : *deques_[next_deque_++ % deques_.size()];
+        {
+            std::lock_guard<std::mutex> lock(deque.mutex);
+            deque.tasks.push_back(std::move(task));
+        }
+        has_tasks_.notify_one();
+    }
+
+    bool try_pop(size_t home, Task& task) {
+        // Take the newest task from the home deque
+        {
+            auto& deque = *deques_[home];
+            std::lock_guard<std::mutex> lock(deque.mutex);
+            if (not deque.tasks.empty()) {
+                task = std::move(deque.tasks.back());
+                deque.tasks.pop_back();
+                pending_tasks_--;
+                return true;
+            }
+        }
+
+        // Steal the oldest task from the other deques
+        for (size_t i = 1; i < deques_.size(); i++) {
+            auto& deque = *deques_[(home + i) % deques_.size()];
+            std::lock_guard<std::mutex> lock(deque.mutex);
+            if (not deque.tasks.empty()) {
+                task = std::move(deque.tasks.front());
+                deque.tasks.pop_front();
+                pending_tasks_--;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void run(size_t home) {
+        current_pool() = this;
+        current_deque() = home;
+        while (true) {
+            Task task;
+            if (try_pop(home, task)) {
+                task();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(mutex_);
+            has_tasks_.wait(lock, [this]() {
+                return not is_running_ || pending_tasks_ > 0;
+            });
+            if (not is_running_) {
+                return;
+            }
+        }
+    }
+};
+
+// Forks tasks on a pool and joins them. Without a pool or its workers the
+// tasks run at once in the calling thread. The joining thread executes pool
+// tasks while it waits, so groups may be nested inside the tasks.
+class TaskGroup
+{
+    static constexpr size_t NO_FAILED_TASK = (size_t)-1;
+
+public:
+    explicit TaskGroup(WorkStealingPool* pool):
+        pool_(pool && pool->workerNumber() ? pool : nullptr),
+        forked_tasks_(0), remaining_tasks_(0),
+        failed_task_(NO_FAILED_TASK) {}
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    // Exceptions of the tasks are dropped if wait() is not called
+    ~TaskGroup() {join();}
+
+    template<class Function>
+    void run(Function&& function) {
+        auto index = forked_tasks_++;
+        if (not pool_) {
+            call(index, function);
+            return;
+        }
+
+        remaining_tasks_++;
+        pool_->push(
+            [this, index, function = std::forward<Function>(function)]
+            () mutable {
+                call(index, function);
+                remaining_tasks_--;
+            }
+        );
+    }
+
+    // Rethrows the exception of the earliest forked task that failed, so
+    // the result does not depend on the order in which the tasks ran
+    void wait() {
+        join();
+        if (exception_) {
+            auto exception = exception_;
+            exception_ = nullptr;
+            failed_task_ = NO_FAILED_TASK;
+            std::rethrow_exception(exception);
+        }
+    }
+
+private:
+    WorkStealingPool* pool_;
+    size_t forked_tasks_;
+    std::atomic<size_t> remaining_tasks_;
+
+    std::mutex exception_mutex_;
+    size_t failed_task_;
+    std::exception_ptr exception_;
+
+    void join() {
+        if (not pool_) return;
+        auto home = pool_->home_deque();
+        while (remaining_tasks_ > 0) {
+            Task task;
+            if (pool_->try_pop(home, task)) {
+                task();
+            }
+            else {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    template<class Function>
+    void call(size_t index, Function& function) {
+        try {
+            function();
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(exception_mutex_);
+            if (index < failed_task_) {
+                failed_task_ = index;
+                exception_ = std::current_exception();
+            }
+        }
+    }
+};
+
+// Calls body(begin, end) on chunks of [0, size), or once on the whole range
+// without a pool. Chunks run in any order, so the results that must be
+// deterministic are stored per index and merged after the call.
+template<class Body>
+void parallelFor(WorkStealingPool* pool, size_t size, size_t grain_size,
+                 const Body& body)
+{
+    grain_size = std::max(grain_size, (size_t)1);
+    if (not pool || 0u == pool->workerNumber() || size <= grain_size) {
+        if (size) body((size_t)0, size);
+        return;
+    }
+
+    TaskGroup group(pool);
+    for (size_t begin = 0; begin < size; begin += grain_size) {
+        auto end = std::min(begin + grain_size, size);
+        group.run([&body, begin, end]() {
+            body(begin, end);
+        });
+    }
+    group.wait();
+}
+
+template<class Body>
+void WorkStealingPool::parallelFor(size_t size, size_t grain_size,
+                                   const Body& body)
+{
+    ::parallelFor(this, size, grain_size, body);
+}
@@ -7,6 +7,8 @@ using namespace fluid_msg;
 
 const SwitchInfo* SwitchManager::getSwitch(ConnectionId connection_id) const
 {
+    // Elements keep their addresses until the switch is deleted
+    std::lock_guard<std::mutex> lock(mutex_);
     auto switch_iter = switch_map_.find(connection_id);
     if (switch_map_.end() != switch_iter) {
         return &switch_iter->second;
@@ -16,6 +18,7 @@ const SwitchInfo* SwitchManager::getSwitch(ConnectionId connection_id) const
 
 void SwitchManager::addSwitch(ConnectionId connection_id, SwitchInfo&& info)
 {
+    std::lock_guard<std::mutex> lock(mutex_);
     auto connection_iter = connection_map_.find(info.id);
     if (connection_map_.end() == connection_iter) {
         std::cout << "Switch dpid=" << info.id << " connected" << std::endl;
@@ -38,6 +41,7 @@ void SwitchManager::addSwitch(ConnectionId connection_id, SwitchInfo&& info)
 
 void SwitchManager::deleteSwitch(ConnectionId connection_id)
 {
+    std::lock_guard<std::mutex> lock(mutex_);
     auto switch_iter = switch_map_.find(connection_id);
     if (switch_map_.end() != switch_iter) {
         auto switch_id = switch_iter->second.id;
@@ -55,6 +59,7 @@ void SwitchManager::deleteSwitch(ConnectionId connection_id)
 std::pair<ConnectionId, bool>
 SwitchManager::getConnectionId(SwitchId switch_id) const
 {
+    std::lock_guard<std::mutex> lock(mutex_);
     auto it = connection_map_.find(switch_id);
     return connection_map_.end() != it
            ? std::make_pair(it->second, true)
@@ -233,18 +238,22 @@ void StatsQuerier::sendRuleStats(RuleReplyPtr reply)
     }
 }
 
-void StatsQuerier::getRuleStats(RequestId request_id, RuleInfoPtr info)
+void StatsQuerier::getRuleStats(RequestId request_id, RuleInfoPtr info,
+                                Cookie cookie_mask)
 {
     auto result = switch_manager_.getConnectionId(info->switch_id);
     if (result.second) {
         // Save request id
         auto xid = xid_manager_.getXid();
-        request_id_map_.emplace(xid, request_id);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            request_id_map_.emplace(xid, request_id);
+        }
         //std::cout<<"~~~~~STATS REQUESTED ("<<xid<<")~~~~~"<<std::endl;
 
         // Send rule stats request
         auto connection_id = result.first;
-        auto request_flow = Parser::getMultipartRequestFlow(info);
+        auto request_flow = Parser::getMultipartRequestFlow(info, cookie_mask);
         request_flow.xid(xid);
         sender_.send(connection_id, Destination::TO_SWITCH, request_flow);
     }
@@ -262,7 +271,10 @@ void StatsQuerier::getPortStats(RequestId request_id,
     if (result.second) {
         // Save request id
         auto xid = xid_manager_.getXid();
-        request_id_map_.emplace(xid, request_id);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            request_id_map_.emplace(xid, request_id);
+        }
 
         // Send port stats request
         auto connection_id = result.first;
@@ -276,20 +288,25 @@ void StatsQuerier::getPortStats(RequestId request_id,
     }
 }
 
-std::pair<RequestId, bool> StatsQuerier::popRequestId(uint32_t xid)
+std::pair<RequestId, bool> StatsQuerier::popRequestId(uint32_t xid,
+                                                      bool last_part)
 {
+    std::lock_guard<std::mutex> lock(mutex_);
     auto it = request_id_map_.find(xid);
     if (request_id_map_.end() != it) {
         auto request_id = it->second;
-        request_id_map_.erase(it);
+        if (last_part) {
+            request_id_map_.erase(it);
+        }
         return std::make_pair(request_id, true);
     }
     return std::make_pair((uint32_t)-1, false);
 }
 
 Controller::Controller(std::shared_ptr<Alarm> alarm, Sender sender,
-                       std::string measurement_filename):
-    detector(alarm),
+                       std::string measurement_filename,
+                       size_t worker_number):
+    detector(alarm, worker_number),
     xid_manager(),
     switch_manager(detector),
     link_discovery(switch_manager, detector),
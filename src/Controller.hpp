@@ -14,7 +14,9 @@
 #include <fluid/of10/openflow-10.h>
 #include <fluid/of13/openflow-13.h>
 
+#include <atomic>
 #include <cstdint>
+#include <mutex>
 
 class XidManager
 {
@@ -29,7 +31,7 @@ public:
 
     }
 private:
-    uint32_t last_id_;
+    std::atomic<uint32_t> last_id_;
 };
 
 class SwitchManager
@@ -46,6 +48,8 @@ public:
 private:
     Detector& detector_;
 
+    // Switches are added and looked up by the pipeline shards
+    mutable std::mutex mutex_;
     std::unordered_map<SwitchId, ConnectionId> connection_map_;
     std::unordered_map<ConnectionId, SwitchInfo> switch_map_;
 };
@@ -101,17 +105,22 @@ public:
     void sendRuleStats(RuleReplyPtr reply);
 
     //void getPortDesc(ConnectionId id);
-    void getRuleStats(RequestId request_id, RuleInfoPtr info);
+    void getRuleStats(RequestId request_id, RuleInfoPtr info,
+                      Cookie cookie_mask = EXACT_COOKIE_MASK);
     void getPortStats(RequestId request_id, SwitchId switch_id, PortId port_id);
 
     // TODO: consider using std::optional
-    std::pair<RequestId, bool> popRequestId(uint32_t xid);
+    // The request id is kept until the last part of a reply
+    std::pair<RequestId, bool> popRequestId(uint32_t xid,
+                                            bool last_part = true);
 
 private:
     XidManager& xid_manager_;
     SwitchManager& switch_manager_;
     Sender sender_;
 
+    // Replies are matched to requests by the pipeline shards
+    std::mutex mutex_;
     std::map<uint32_t, RequestId> request_id_map_;
 };
 
@@ -126,7 +135,7 @@ private:
 struct Controller
 {
     Controller(std::shared_ptr<Alarm> alarm, Sender sender,
-               std::string measurement_filename);
+               std::string measurement_filename, size_t worker_number = 0);
 
     Detector detector;
     XidManager xid_manager;
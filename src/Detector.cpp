@@ -1,20 +1,36 @@
 #include "Detector.hpp"
 
+#include <algorithm>
 #include <memory>
+#include <mutex>
+#include <set>
 
 class Detector::Impl
 {
 public:
-    explicit Impl(InstructionQueue& instruction_queue);
+    Impl(InstructionQueue& instruction_queue, std::shared_ptr<Alarm> alarm,
+         size_t worker_number);
 
-    void fillMeasurement(PerformanceMeasurementPtr measurement);
+    void fillMeasurement(PerformanceMeasurementPtr measurement,
+                         size_t queue_depth,
+                         Executor::Duration task_latency);
 
     void addSwitch(SwitchInfo&& info);
     void deleteSwitch(SwitchId id);
 
+    // Rule updates are buffered by the submitting thread
     void addRule(RuleInfo&& info);
     void changeRule(RuleInfo&& info);
     void deleteRule(RuleInfo&& info);
+    uint64_t cutRuleOperations();
+    // Applies the rule updates that were submitted before the cut, but not
+    // those after the cut of an earlier task that has not run yet
+    void applyRuleOperations(uint64_t bound);
+
+    void addGroup(GroupInfo&& info);
+    void changeGroup(GroupInfo&& info);
+    void deleteGroup(SwitchId switch_id, GroupId group_id);
+    void deleteAllGroups(SwitchId switch_id);
 
     void addLink(TopoId src_topo_id, TopoId dst_topo_id);
     void deleteLink(TopoId src_topo_id, TopoId dst_topo_id);
@@ -24,6 +40,7 @@ public:
 
     void addRuleStats(RequestId request_id, RuleInfo&& info,
                       RuleStatsFields stats);
+    void completeRuleStats(RequestId request_id);
     void addPortStats(RequestId request_id, PortInfo&& info,
                       PortStatsFields stats);
 
@@ -31,45 +48,74 @@ public:
 
 private:
     InstructionQueue& instruction_queue_;
+    std::shared_ptr<Alarm> alarm_;
 
     // TODO: take away xids that are used by the controller
     std::shared_ptr<RequestIdGenerator> xid_generator_;
 
+    // The detector thread helps the pool, so it gets one worker less
+    std::shared_ptr<WorkStealingPool> pool_;
+
     std::shared_ptr<Network> network_;
     std::shared_ptr<DependencyGraph> dependency_graph_;
     std::unique_ptr<FlowPredictor> flow_predictor_;
 
     std::map<RequestId, RequestPtr> pending_requests_;
 
+    // Rule updates are merged until something depends on the network
+    std::mutex rule_operations_mutex_;
+    RuleOperationBuffer rule_operations_;
+    // Cuts of the submitted tasks that have not applied them yet
+    std::multiset<uint64_t> pending_cuts_;
+
+    // New rules are added to the dependency graph in batches, so their
+    // switches are processed concurrently
+    std::vector<RulePtr> pending_rules_;
+
     RulePtr get_rule(const RuleInfo& info);
     std::list<RulePtr> get_matching_rules(const RuleInfo& info);
     void add_rule(RuleInfo&& info);
+    void change_rule(RuleInfo&& info, bool must_exist);
+    void delete_matching_rules(const RuleInfo& info);
     void delete_rule(RulePtr rule);
 
+    void schedule_tick();
+    void flush_pending_rules();
     void add_rule_to_predictor(RulePtr rule);
     void delete_rule_from_predictor(RulePtr rule);
     void add_link_to_predictor(Link link);
     void delete_link_from_predictor(Link link);
+    void add_group_to_predictor(GroupPtr group);
+    void delete_group_from_predictor(GroupPtr group);
 
 };
 
-Detector::Impl::Impl(InstructionQueue& instruction_queue):
-    instruction_queue_(instruction_queue)
+Detector::Impl::Impl(InstructionQueue& instruction_queue,
+                     std::shared_ptr<Alarm> alarm, size_t worker_number):
+    instruction_queue_(instruction_queue), alarm_(alarm)
 {
     xid_generator_ = std::make_shared<RequestIdGenerator>();
 
+    pool_ = std::make_shared<WorkStealingPool>(
+        0u == worker_number ? WorkStealingPool::defaultWorkerNumber()
+                            : worker_number - 1u
+    );
+
     network_ = std::make_shared<Network>();
-    dependency_graph_ = std::make_shared<DependencyGraph>(network_);
+    dependency_graph_ = std::make_shared<DependencyGraph>(network_, pool_);
     flow_predictor_ = std::make_unique<FlowPredictor>(dependency_graph_,
-                                                      xid_generator_);
+                                                      xid_generator_, pool_);
 
     add_rule_to_predictor(network_->dropRule());
     add_rule_to_predictor(network_->controllerRule());
 }
 
-void Detector::Impl::fillMeasurement(PerformanceMeasurementPtr measurement)
+void Detector::Impl::fillMeasurement(PerformanceMeasurementPtr measurement,
+                                     size_t queue_depth,
+                                     Executor::Duration task_latency)
 {
-    measurement->fill(dependency_graph_->size(), network_->size());
+    measurement->fill(dependency_graph_->size(), network_->size(),
+                      queue_depth, task_latency);
 }
 
 void Detector::Impl::addSwitch(SwitchInfo&& info)
@@ -84,6 +130,7 @@ void Detector::Impl::addSwitch(SwitchInfo&& info)
     for (auto table : sw->tables()) {
         add_rule_to_predictor(table->tableMissRule());
     }
+    schedule_tick();
 }
 
 void Detector::Impl::deleteSwitch(SwitchId id)
@@ -110,6 +157,9 @@ void Detector::Impl::deleteSwitch(SwitchId id)
             delete_rule_from_predictor(rule);
         }
     }
+    for (auto group : sw->groups()) {
+        delete_group_from_predictor(group);
+    }
 
     // Cleanup data structures
     network_->deleteSwitch(id);
@@ -122,48 +172,123 @@ void Detector::Impl::deleteSwitch(SwitchId id)
         assert(dependency_graph_->size() == 2);
         // TODO: Check FlowPredictor
     }
+    schedule_tick();
 }
 
 void Detector::Impl::addRule(RuleInfo&& info)
 {
-    auto rule = get_rule(info);
-    if (not rule) {
-        //DEBUG//std::cout<<"[Detector] FlowMod::ADD "<<info<<std::endl;
-        add_rule(std::move(info));
-    }
-    else {
-        // TODO: Check if the controller installs the same rule
-        //std::cout<<"[Detector] FlowMod::CHANGE "<<info<<std::endl;
-        //delete_rule(rule);
-    }
+    //DEBUG//std::cout<<"[Detector] FlowMod::ADD "<<info<<std::endl;
+    std::lock_guard<std::mutex> lock(rule_operations_mutex_);
+    rule_operations_.addRule(std::move(info));
 }
 
 void Detector::Impl::changeRule(RuleInfo&& info)
 {
     //DEBUG//std::cout<<"[Detector] FlowMod::CHANGE "<<info<<std::endl;
-    auto rule = get_rule(info);
-    if (rule) {
-        delete_rule(rule);
-        add_rule(std::move(info));
+    std::lock_guard<std::mutex> lock(rule_operations_mutex_);
+    rule_operations_.changeRule(std::move(info));
+}
+
+void Detector::Impl::deleteRule(RuleInfo&& info)
+{
+    //DEBUG//std::cout<<"[Detector] FlowMod::DELETE "<<info<<std::endl;
+    std::lock_guard<std::mutex> lock(rule_operations_mutex_);
+    rule_operations_.deleteRule(std::move(info));
+}
+
+uint64_t Detector::Impl::cutRuleOperations()
+{
+    std::lock_guard<std::mutex> lock(rule_operations_mutex_);
+    auto bound = rule_operations_.cut();
+    pending_cuts_.insert(bound);
+    return bound;
+}
+
+void Detector::Impl::applyRuleOperations(uint64_t bound)
+{
+    std::vector<RuleOperation> operations;
+    {
+        std::lock_guard<std::mutex> lock(rule_operations_mutex_);
+        pending_cuts_.erase(pending_cuts_.find(bound));
+        if (not pending_cuts_.empty()) {
+            bound = std::min(bound, *pending_cuts_.begin());
+        }
+        operations = rule_operations_.popOperations(bound);
+    }
+    for (auto& operation : operations) {
+        switch (operation.type) {
+        case RuleOperationType::ADD:
+            if (not get_rule(operation.info)) {
+                add_rule(std::move(operation.info));
+            }
+            // TODO: Check if the controller installs the same rule
+            break;
+        case RuleOperationType::MODIFY:
+            change_rule(std::move(operation.info), true);
+            break;
+        case RuleOperationType::ADD_OR_MODIFY:
+            change_rule(std::move(operation.info), false);
+            break;
+        case RuleOperationType::DELETE:
+            delete_matching_rules(operation.info);
+            break;
+        }
+    }
+}
+
+void Detector::Impl::addGroup(GroupInfo&& info)
+{
+    auto group = network_->addGroup(std::move(info));
+    if (group) {
+        add_group_to_predictor(group);
+    }
+}
+
+void Detector::Impl::changeGroup(GroupInfo&& info)
+{
+    auto group = network_->getGroup(info.switch_id, info.group_id);
+    if (group) {
+        // Edges from the rules that use the group are deleted with the
+        // group rule and restored when the group is added back
+        delete_group_from_predictor(group);
+        network_->modifyGroup(std::move(info));
+        add_group_to_predictor(group);
     }
     else {
-        throw std::logic_error("Change non-existing rule");
+        throw std::logic_error("Change non-existing group");
     }
 }
 
-void Detector::Impl::deleteRule(RuleInfo&& info)
+void Detector::Impl::deleteGroup(SwitchId switch_id, GroupId group_id)
 {
-    //DEBUG//std::cout<<"[Detector] FlowMod::DELETE "<<info<<std::endl;
-    auto rules = get_matching_rules(info);
-    for (const auto& rule : rules) {
-        delete_rule(rule);
+    auto group = network_->getGroup(switch_id, group_id);
+    if (group) {
+        // Rules that use the group are deleted with it
+        std::vector<RulePtr> src_rules;
+        for (const auto& rule : group->srcRules()) {
+            src_rules.push_back(rule);
+        }
+        for (const auto& rule : src_rules) {
+            delete_rule(rule);
+        }
+
+        delete_group_from_predictor(group);
+        network_->deleteGroup(switch_id, group_id);
+    }
+}
+
+void Detector::Impl::deleteAllGroups(SwitchId switch_id)
+{
+    auto sw = network_->getSwitch(switch_id);
+    if (not sw) return;
+
+    std::vector<GroupId> group_ids;
+    for (const auto& group : sw->groups()) {
+        group_ids.push_back(group->id());
+    }
+    for (auto group_id : group_ids) {
+        deleteGroup(switch_id, group_id);
     }
-    //auto rule = get_rule(info);
-    //if (rule) {
-    //    delete_rule(rule);
-    //} else {
-    //    throw std::logic_error("Delete non-existing rule");
-    //}
 }
 
 void Detector::Impl::addLink(TopoId src_topo_id, TopoId dst_topo_id)
@@ -178,6 +303,7 @@ void Detector::Impl::addLink(TopoId src_topo_id, TopoId dst_topo_id)
 
         auto link = link_pair.first;
         add_link_to_predictor(link);
+        schedule_tick();
     }
 }
 
@@ -193,6 +319,7 @@ void Detector::Impl::deleteLink(TopoId src_topo_id, TopoId dst_topo_id)
 
         auto link = link_pair.first;
         delete_link_from_predictor(link);
+        schedule_tick();
     }
 }
 
@@ -201,6 +328,7 @@ void Detector::Impl::getRuleStats(RequestId request_id, RuleInfo&& info)
     auto rules = get_matching_rules(info);
     if (not rules.empty()) {
         flow_predictor_->predictFlow(request_id, rules);
+        schedule_tick();
     }
     else {
         std::cout << "[Detector] No matching rules" << std::endl;
@@ -221,10 +349,8 @@ void Detector::Impl::addRuleStats(RequestId request_id, RuleInfo&& info,
     if (it != pending_requests_.end()) {
         auto rule_request = RuleRequest::pointerCast(it->second);
         assert(rule_request != nullptr);
-        rule_request->stats = stats;
-        flow_predictor_->passRequest(rule_request);
-
-        pending_requests_.erase(it);
+        // One reply may carry stats of several rules
+        rule_request->addStats(info.cookie, stats);
 
         // TODO: change this
         //return StatsStatus::APPLIED;
@@ -235,6 +361,18 @@ void Detector::Impl::addRuleStats(RequestId request_id, RuleInfo&& info,
     }
 }
 
+void Detector::Impl::completeRuleStats(RequestId request_id)
+{
+    auto it = pending_requests_.find(request_id);
+    if (it != pending_requests_.end()) {
+        flow_predictor_->passRequest(it->second);
+        pending_requests_.erase(it);
+        if (flow_predictor_->instructionReady()) {
+            schedule_tick();
+        }
+    }
+}
+
 void Detector::Impl::addPortStats(RequestId request_id, PortInfo&& info,
                                   PortStatsFields stats)
 {
@@ -258,6 +396,7 @@ void Detector::Impl::addPortStats(RequestId request_id, PortInfo&& info,
 
 void Detector::Impl::prepareInstructions()
 {
+    flush_pending_rules();
     auto diff = dependency_graph_->popEdgeDiff();
     flow_predictor_->updateEdges(diff);
     auto instruction = flow_predictor_->getInstruction();
@@ -290,7 +429,29 @@ void Detector::Impl::add_rule(RuleInfo&& info)
         info.switch_id, info.table_id, info.priority, info.cookie,
         std::move(info.match), std::move(info.actions)
     );
-    add_rule_to_predictor(rule);
+    if (rule) {
+        add_rule_to_predictor(rule);
+    }
+}
+
+void Detector::Impl::change_rule(RuleInfo&& info, bool must_exist)
+{
+    auto rule = get_rule(info);
+    if (rule) {
+        delete_rule(rule);
+    }
+    else if (must_exist) {
+        throw std::logic_error("Change non-existing rule");
+    }
+    add_rule(std::move(info));
+}
+
+void Detector::Impl::delete_matching_rules(const RuleInfo& info)
+{
+    auto rules = get_matching_rules(info);
+    for (const auto& rule : rules) {
+        delete_rule(rule);
+    }
 }
 
 void Detector::Impl::delete_rule(RulePtr rule)
@@ -299,36 +460,71 @@ void Detector::Impl::delete_rule(RulePtr rule)
     network_->deleteRule(rule->id());
 }
 
+void Detector::Impl::schedule_tick()
+{
+    // Large stats buckets are sent without waiting for the deadline
+    if (flow_predictor_->requestsReady()) {
+        alarm_->expire();
+    }
+    else {
+        alarm_->scheduleTick();
+    }
+}
+
+void Detector::Impl::flush_pending_rules()
+{
+    if (not pending_rules_.empty()) {
+        dependency_graph_->addRules(pending_rules_);
+        pending_rules_.clear();
+    }
+}
+
 void Detector::Impl::add_rule_to_predictor(RulePtr rule)
 {
     //DEBUG//std::cout<<"[Graph] ADD "<<rule<<std::endl;
-    dependency_graph_->addRule(rule);
+    pending_rules_.push_back(rule);
     //flow_predictor_->updateEdges(diff);
 }
 
 void Detector::Impl::delete_rule_from_predictor(RulePtr rule)
 {
     //DEBUG//std::cout<<"[Graph] DELETE "<<rule<<std::endl;
+    flush_pending_rules();
     dependency_graph_->deleteRule(rule);
     //flow_predictor_->updateEdges(diff);
 }
 
 void Detector::Impl::add_link_to_predictor(Link link)
 {
+    flush_pending_rules();
     dependency_graph_->addLink(link);
     //flow_predictor_->updateEdges(diff);
 }
 
+void Detector::Impl::add_group_to_predictor(GroupPtr group)
+{
+    // Rules that use the group must be in the graph to get edges to it
+    flush_pending_rules();
+    dependency_graph_->addGroup(group);
+}
+
+void Detector::Impl::delete_group_from_predictor(GroupPtr group)
+{
+    flush_pending_rules();
+    dependency_graph_->deleteGroup(group);
+}
+
 void Detector::Impl::delete_link_from_predictor(Link link)
 {
+    flush_pending_rules();
     dependency_graph_->deleteLink(link);
     //flow_predictor_->updateEdges(diff);
 }
 
-Detector::Detector(std::shared_ptr<Alarm> alarm):
-    instruction_queue_(alarm)
+Detector::Detector(std::shared_ptr<Alarm> alarm, size_t worker_number):
+    alarm_(alarm), instruction_queue_(alarm, INSTRUCTION_QUEUE_CAPACITY)
 {
-    impl_ = std::make_unique<Impl>(instruction_queue_);
+    impl_ = std::make_unique<Impl>(instruction_queue_, alarm, worker_number);
 }
 
 Detector::~Detector()
@@ -339,65 +535,108 @@ Detector::~Detector()
 void Detector::fillMeasurement(PerformanceMeasurementPtr measurement)
 {
     executor_.addTask([this, measurement]() mutable {
-        impl_->fillMeasurement(measurement);
-    });
+        impl_->fillMeasurement(measurement, executor_.queueDepth(),
+                               executor_.taskLatency());
+    }, Executor::Priority::LOW);
 }
 
 void Detector::addSwitch(SwitchInfo info)
 {
-    executor_.addTask([this, info = std::move(info)]() mutable {
+    executor_.addTask([this, bound = impl_->cutRuleOperations(),
+                       info = std::move(info)]() mutable {
+        impl_->applyRuleOperations(bound);
         impl_->addSwitch(std::move(info));
-    });
+    }, Executor::Priority::NORMAL);
 }
 
 void Detector::deleteSwitch(SwitchId id)
 {
-    executor_.addTask([this, id]() {
+    executor_.addFence([this, bound = impl_->cutRuleOperations(), id]() {
+        impl_->applyRuleOperations(bound);
         impl_->deleteSwitch(id);
     });
 }
 
 void Detector::addRule(RuleInfo info)
 {
-    executor_.addTask([this, info = std::move(info)]() mutable {
-        impl_->addRule(std::move(info));
-    });
+    impl_->addRule(std::move(info));
 }
 
 void Detector::changeRule(RuleInfo info)
 {
-    executor_.addTask([this, info = std::move(info)]() mutable {
-        impl_->changeRule(std::move(info));
-    });
+    impl_->changeRule(std::move(info));
 }
 
 void Detector::deleteRule(RuleInfo info)
 {
-    executor_.addTask([this, info = std::move(info)]() mutable {
-        impl_->deleteRule(std::move(info));
-    });
+    impl_->deleteRule(std::move(info));
+}
+
+void Detector::addGroup(GroupInfo info)
+{
+    executor_.addTask([this, bound = impl_->cutRuleOperations(),
+                       info = std::move(info)]() mutable {
+        impl_->applyRuleOperations(bound);
+        impl_->addGroup(std::move(info));
+    }, Executor::Priority::LOW);
+}
+
+void Detector::changeGroup(GroupInfo info)
+{
+    executor_.addTask([this, bound = impl_->cutRuleOperations(),
+                       info = std::move(info)]() mutable {
+        impl_->applyRuleOperations(bound);
+        impl_->changeGroup(std::move(info));
+    }, Executor::Priority::LOW);
+}
+
+void Detector::deleteGroup(SwitchId switch_id, GroupId group_id)
+{
+    executor_.addTask([this, bound = impl_->cutRuleOperations(),
+                       switch_id, group_id]() {
+        impl_->applyRuleOperations(bound);
+        impl_->deleteGroup(switch_id, group_id);
+    }, Executor::Priority::LOW);
+}
+
+void Detector::deleteAllGroups(SwitchId switch_id)
+{
+    executor_.addTask([this, bound = impl_->cutRuleOperations(),
+                       switch_id]() {
+        impl_->applyRuleOperations(bound);
+        impl_->deleteAllGroups(switch_id);
+    }, Executor::Priority::LOW);
 }
 
 void Detector::addLink(TopoId src_topo_id, TopoId dst_topo_id)
 {
-    executor_.addTask([this, src_topo_id, dst_topo_id]() {
+    executor_.addTask([this, bound = impl_->cutRuleOperations(),
+                       src_topo_id, dst_topo_id]() {
+        impl_->applyRuleOperations(bound);
         impl_->addLink(src_topo_id, dst_topo_id);
-    });
+    }, Executor::Priority::NORMAL);
 }
 
 void Detector::deleteLink(TopoId src_topo_id, TopoId dst_topo_id)
 {
-    executor_.addTask([this, src_topo_id, dst_topo_id]() {
+    executor_.addTask([this, bound = impl_->cutRuleOperations(),
+                       src_topo_id, dst_topo_id]() {
+        impl_->applyRuleOperations(bound);
         impl_->deleteLink(src_topo_id, dst_topo_id);
-    });
+    }, Executor::Priority::NORMAL);
 }
 
 void Detector::getRuleStats(RequestId request_id, RuleInfo info)
 {
+    // The request overtakes the queued tasks, but sees every rule update
+    // of the controller that was submitted before it
     executor_.addTask(
-        [this, request_id, info = std::move(info)]() mutable {
+        [this, bound = impl_->cutRuleOperations(), request_id,
+         info = std::move(info)]() mutable {
+            impl_->applyRuleOperations(bound);
             impl_->getRuleStats(request_id, std::move(info));
-        }
+        },
+        Executor::Priority::HIGH
     );
 }
 
@@ -406,7 +645,8 @@ void Detector::getPortStats(RequestId request_id, PortInfo info)
     executor_.addTask(
         [this, request_id, info = std::move(info)]() mutable {
             impl_->getPortStats(request_id, std::move(info));
-        }
+        },
+        Executor::Priority::HIGH
     );
 }
 
@@ -416,7 +656,18 @@ void Detector::addRuleStats(RequestId request_id, RuleInfo info,
     executor_.addTask(
         [this, request_id, info = std::move(info), stats]() mutable {
             impl_->addRuleStats(request_id, std::move(info), stats);
-        }
+        },
+        Executor::Priority::HIGH
+    );
+}
+
+void Detector::completeRuleStats(RequestId request_id)
+{
+    executor_.addTask(
+        [this, request_id]() {
+            impl_->completeRuleStats(request_id);
+        },
+        Executor::Priority::HIGH
     );
 }
 
@@ -426,13 +677,15 @@ void Detector::addPortStats(RequestId request_id, PortInfo info,
     executor_.addTask(
         [this, request_id, info = std::move(info), stats]() mutable {
             impl_->addPortStats(request_id, std::move(info), stats);
-        }
+        },
+        Executor::Priority::HIGH
     );
 }
 
 void Detector::prepareInstructions()
 {
-    executor_.addTask([this]() {
+    executor_.addFence([this, bound = impl_->cutRuleOperations()]() {
+        impl_->applyRuleOperations(bound);
         impl_->prepareInstructions();
     });
 }
@@ -4,6 +4,7 @@
 #include "PerformanceMonitor.hpp"
 #include "network/Network.hpp"
 #include "network/DependencyGraph.hpp"
+#include "network/RuleOperations.hpp"
 #include "flow_predictor/FlowPredictor.hpp"
 
 #include <memory>
@@ -13,25 +14,32 @@ using InstructionQueue = ConcurrentAlarmingQueue<Instruction>;
 class Detector
 {
 public:
-    explicit Detector(std::shared_ptr<Alarm> alarm);
+    // Zero worker number means one worker per hardware thread
+    explicit Detector(std::shared_ptr<Alarm> alarm, size_t worker_number = 0);
     ~Detector();
 
     // TODO: make soft instruction request
 
-    bool instructionsExist() {
+    bool instructionsExist() const {
         return not instruction_queue_.empty();
     }
 
-    size_t instructionNumber() {
+    size_t instructionNumber() const {
         return instruction_queue_.size();
     }
 
-    Instruction getInstruction() {
-        return instruction_queue_.pop();
+    size_t popInstructions(std::vector<Instruction>& instructions) {
+        return instruction_queue_.popAll(instructions);
     }
 
     void fillMeasurement(PerformanceMeasurementPtr measurement);
 
+    // Rule updates are buffered when they are submitted, and every task
+    // first applies the rule updates that were submitted before it and
+    // before the tasks it overtakes. Stats tasks overtake queued topology
+    // and group updates, as OpenFlow allows without a barrier, and topology
+    // overtakes groups. Switch deletion and instruction preparation are
+    // ordered with everything.
     void addSwitch(SwitchInfo info);
     void deleteSwitch(SwitchId id);
 
@@ -39,6 +47,11 @@ public:
     void changeRule(RuleInfo info);
     void deleteRule(RuleInfo info);
 
+    void addGroup(GroupInfo info);
+    void changeGroup(GroupInfo info);
+    void deleteGroup(SwitchId switch_id, GroupId group_id);
+    void deleteAllGroups(SwitchId switch_id);
+
     void addLink(TopoId src_topo_id, TopoId dst_topo_id);
     void deleteLink(TopoId src_topo_id, TopoId dst_topo_id);
 
@@ -48,14 +61,26 @@ public:
     // TODO: do we need to check match, or we can only check xid ?
     void addRuleStats(RequestId request_id, RuleInfo info,
                       RuleStatsFields stats);
+    // Must be called after the last rule stats of a reply
+    void completeRuleStats(RequestId request_id);
     void addPortStats(RequestId request_id, PortInfo info,
                       PortStatsFields stats);
 
     void prepareInstructions();
+    // Instructions are prepared at most one tick deadline later
+    void scheduleTick() {alarm_->scheduleTick();}
+    // Finishes the submitted tasks and stops the detector thread, tasks
+    // submitted afterwards are discarded
+    void stop(Executor::StopPolicy policy = Executor::StopPolicy::DRAIN) {
+        executor_.stop(policy);
+    }
 
     class Impl;
 
 private:
+    static constexpr size_t INSTRUCTION_QUEUE_CAPACITY = 1024;
+
+    std::shared_ptr<Alarm> alarm_;
     InstructionQueue instruction_queue_;
     std::unique_ptr<Impl> impl_;
 
@@ -1,6 +1,7 @@
 #include "Compromutator.hpp"
 
 #include <array>
+#include <csignal>
 #include <typeinfo>
 #include <iostream>
 #include <list>
@@ -12,6 +13,17 @@
 
 using namespace std;
 
+namespace {
+Compromutator* running_compromutator = nullptr;
+
+void handle_stop_signal(int)
+{
+    if (running_compromutator) {
+        running_compromutator->stop();
+    }
+}
+}
+
 int main(int argc, char* argv[])
 {
     HeaderSpace::GLOBAL_LENGTH = Mapping::HEADER_SIZE;
@@ -24,10 +36,15 @@ int main(int argc, char* argv[])
          cxxopts::value<std::string>()->default_value("127.0.0.1"), "IP")
         ("p,port", "Controller port",
          cxxopts::value<uint32_t>()->default_value("6633"), "PORT")
-        ("t,timeout", "Timeout duration in milliseconds",
+        ("t,timeout", "Maximal detector latency in milliseconds",
          cxxopts::value<uint32_t>()->default_value("10"), "MS")
         ("m,measurement_filename", "CSV file to save performance measurements",
-         cxxopts::value<std::string>()->default_value(""), "FILE");
+         cxxopts::value<std::string>()->default_value(""), "FILE")
+        ("w,workers", "Detector worker threads, 0 uses all hardware threads",
+         cxxopts::value<uint32_t>()->default_value("0"), "N")
+        ("s,shards", "Pipeline threads that handle switch connections, "
+         "0 uses the default number",
+         cxxopts::value<uint32_t>()->default_value("0"), "N");
     auto result = options.parse(argc, argv);
 
     ProxySettings proxy_settings;
@@ -39,10 +56,15 @@ int main(int argc, char* argv[])
     Compromutator compromutator(
         proxy_settings,
         result["timeout"].as<uint32_t>(),
-        result["measurement_filename"].as<std::string>()
+        result["measurement_filename"].as<std::string>(),
+        result["workers"].as<uint32_t>(),
+        result["shards"].as<uint32_t>()
      );
+    running_compromutator = &compromutator;
+    std::signal(SIGINT, handle_stop_signal);
+    std::signal(SIGTERM, handle_stop_signal);
     compromutator.run();
+    running_compromutator = nullptr;
 
-    // TODO: fix unhandled exception on destructor!
     return 0;
 }
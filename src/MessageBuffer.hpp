@@ -0,0 +1,189 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Allocates message buffers from slabs of fixed size classes. Buffers of
+// messages larger than the largest class are allocated on the heap.
+class MessageBufferPool
+{
+public:
+    static constexpr size_t CLASS_NUMBER = 6;
+    static constexpr size_t HEAP_CLASS = CLASS_NUMBER;
+
+    static MessageBufferPool& instance() {
+        // Never destroyed, so buffers may outlive other static objects
+        static auto pool = new MessageBufferPool();
+        return *pool;
+    }
+
+    MessageBufferPool(const MessageBufferPool&) = delete;
+    MessageBufferPool& operator=(const MessageBufferPool&) = delete;
+
+    static size_t classSize(size_t size_class) {
+        static constexpr size_t CLASS_SIZES[CLASS_NUMBER] = {
+            64u, 256u, 1024u, 4096u, 16384u, 65536u
+        };
+        return CLASS_SIZES[size_class];
+    }
+
+    static size_t sizeClass(size_t size) {
+        for (size_t size_class = 0; size_class < CLASS_NUMBER; size_class++) {
+            if (size <= classSize(size_class)) return size_class;
+        }
+        return HEAP_CLASS;
+    }
+
+    void* allocate(size_t size_class, size_t size) {
+        if (HEAP_CLASS == size_class) {
+            return ::operator new(size);
+        }
+
+        auto& slab_class = classes_[size_class];
+        std::lock_guard<std::mutex> lock(slab_class.mutex);
+        if (slab_class.free_blocks.empty()) {
+            add_slab(slab_class, classSize(size_class));
+        }
+        auto block = slab_class.free_blocks.back();
+        slab_class.free_blocks.pop_back();
+        return block;
+    }
+
+    void deallocate(size_t size_class, void* block) {
+        if (HEAP_CLASS == size_class) {
+            ::operator delete(block);
+            return;
+        }
+
+        auto& slab_class = classes_[size_class];
+        std::lock_guard<std::mutex> lock(slab_class.mutex);
+        slab_class.free_blocks.push_back(block);
+    }
+
+private:
+    // Slabs are never returned, the pool keeps the peak number of buffers
+    static constexpr size_t SLAB_SIZE = 256u * 1024u;
+
+    struct SlabClass {
+        std::mutex mutex;
+        std::vector<void*> free_blocks;
+        std::vector<std::unique_ptr<char[]>> slabs;
+    };
+
+    SlabClass classes_[CLASS_NUMBER];
+
+    MessageBufferPool() = default;
+
+    static void add_slab(SlabClass& slab_class, size_t block_size) {
+        auto block_number = std::max(SLAB_SIZE / block_size, (size_t)1);
+        slab_class.slabs.emplace_back(new char[block_number * block_size]);
+        auto slab = slab_class.slabs.back().get();
+        for (size_t i = 0; i < block_number; i++) {
+            slab_class.free_blocks.push_back(slab + i * block_size);
+        }
+    }
+};
+
+// Reference counted buffer of one OpenFlow message. The bytes either follow
+// the counter in a pooled block or are adopted from libfluid together with
+// the function that frees them, so neither case copies the message.
+class MessageBuffer
+{
+public:
+    using Release = void (*)(void* data);
+
+    MessageBuffer(): header_(nullptr) {}
+
+    // Writable buffer of the given size
+    static MessageBuffer allocate(size_t size) {
+        auto size_class = MessageBufferPool::sizeClass(sizeof(Header) + size);
+        auto block = MessageBufferPool::instance().allocate(
+            size_class, sizeof(Header) + size
+        );
+        auto header = new (block) Header(size_class, size, nullptr, nullptr);
+        header->data = reinterpret_cast<uint8_t*>(header + 1);
+        return MessageBuffer(header);
+    }
+
+    // Takes the ownership of the data, release() is called on it once the
+    // last copy of the buffer is destroyed
+    static MessageBuffer adopt(void* data, size_t size, Release release) {
+        auto size_class = MessageBufferPool::sizeClass(sizeof(Header));
+        auto block = MessageBufferPool::instance().allocate(
+            size_class, sizeof(Header)
+        );
+        auto header = new (block) Header(
+            size_class, size, reinterpret_cast<uint8_t*>(data), release
+        );
+        return MessageBuffer(header);
+    }
+
+    MessageBuffer(const MessageBuffer& other): header_(other.header_) {
+        if (header_) header_->ref_count++;
+    }
+
+    MessageBuffer(MessageBuffer&& other) noexcept: header_(other.header_) {
+        other.header_ = nullptr;
+    }
+
+    MessageBuffer& operator=(const MessageBuffer& other) {
+        MessageBuffer(other).swap(*this);
+        return *this;
+    }
+
+    MessageBuffer& operator=(MessageBuffer&& other) noexcept {
+        MessageBuffer(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    ~MessageBuffer() {
+        if (header_ && 0u == --header_->ref_count) {
+            destroy(header_);
+        }
+    }
+
+    void swap(MessageBuffer& other) noexcept {
+        std::swap(header_, other.header_);
+    }
+
+    explicit operator bool() const {return nullptr != header_;}
+    uint8_t* data() const {return header_ ? header_->data : nullptr;}
+    size_t size() const {return header_ ? header_->size : 0u;}
+    uint32_t useCount() const {
+        return header_ ? header_->ref_count.load() : 0u;
+    }
+
+private:
+    struct Header {
+        Header(size_t size_class, size_t size, uint8_t* data,
+               Release release):
+            ref_count(1u), size_class(size_class), size(size), data(data),
+            release(release) {}
+
+        std::atomic<uint32_t> ref_count;
+        size_t size_class;
+        size_t size;
+        uint8_t* data;
+        Release release;
+    };
+
+    Header* header_;
+
+    explicit MessageBuffer(Header* header): header_(header) {}
+
+    static void destroy(Header* header) {
+        if (header->release) {
+            header->release(header->data);
+        }
+        auto size_class = header->size_class;
+        header->~Header();
+        MessageBufferPool::instance().deallocate(size_class, header);
+    }
+};
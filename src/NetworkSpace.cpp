@@ -156,7 +156,7 @@ NetworkSpace NetworkSpace::operator-(const NetworkSpace& right)
     return domain;
 }
 
-NetworkSpace NetworkSpace::operator&(const NetworkSpace& right)
+NetworkSpace NetworkSpace::operator&(const NetworkSpace& right) const
 {
     // TODO: make it simpler (remove multiple if)
     PortId new_in_port;
@@ -175,6 +175,11 @@ NetworkSpace NetworkSpace::operator&(const NetworkSpace& right)
                     : NetworkSpace(new_in_port, header_ & right.header_);
 }
 
+size_t NetworkSpace::hash() const
+{
+    return header_.hash() * 31u + std::hash<PortId>{}(in_port_);
+}
+
 std::string NetworkSpace::toString() const
 {
     return std::string() +
@@ -253,6 +258,12 @@ NetworkSpace Transfer::inverse(NetworkSpace domain) const
     return NetworkSpace(port, header);
 }
 
+size_t Transfer::hash() const
+{
+    return (header_changer_.hash() * 31u + std::hash<PortId>{}(src_port_)) *
+           31u + std::hash<PortId>{}(dst_port_);
+}
+
 std::string Transfer::toString() const
 {
     return std::string() +
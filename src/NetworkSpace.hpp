@@ -6,6 +6,7 @@
 enum SpecialPort: PortId
 {
     NONE       = 0x00000000,
+    IN_PORT    = 0xFFFFFFF8,
     ALL        = 0xFFFFFFFC,
     CONTROLLER = 0xFFFFFFFD,
     LOCAL      = 0xFFFFFFFE,
@@ -76,7 +77,13 @@ public:
     NetworkSpace& operator-=(const NetworkSpace& right);
     NetworkSpace operator+(const NetworkSpace& right);
     NetworkSpace operator-(const NetworkSpace& right);
-    NetworkSpace operator&(const NetworkSpace& right);
+    NetworkSpace operator&(const NetworkSpace& right) const;
+
+    size_t hash() const;
+    bool isIdentical(const NetworkSpace& other) const {
+        return in_port_ == other.in_port_ &&
+               header_.isIdentical(other.header_);
+    }
 
     std::string toString() const;
     friend std::ostream& operator<<(std::ostream& os,
@@ -111,6 +118,12 @@ public:
     NetworkSpace apply(NetworkSpace domain) const;
     NetworkSpace inverse(NetworkSpace domain) const;
 
+    size_t hash() const;
+    bool isIdentical(const Transfer& other) const {
+        return src_port_ == other.src_port_ && dst_port_ == other.dst_port_ &&
+               header_changer_.isIdentical(other.header_changer_);
+    }
+
     std::string toString() const;
     friend std::ostream& operator<<(std::ostream& os,
                                     const Transfer& transfer);
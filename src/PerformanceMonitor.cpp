@@ -3,7 +3,7 @@
 PerformanceMeasurement::PerformanceMeasurement(std::string name,
                                                ConnectionId connection_id,
                                                RequestId request_id):
-    graph_size(0), network_size(0),
+    graph_size(0), network_size(0), queue_depth(0), task_latency(0),
     start_time(std::chrono::high_resolution_clock::now()),
     name(name), id({connection_id, request_id}),
     data_filled_(false), finish_set_(false)
@@ -11,11 +11,15 @@ PerformanceMeasurement::PerformanceMeasurement(std::string name,
 
 }
 
-void PerformanceMeasurement::fill(size_t graph_size, size_t network_size)
+void PerformanceMeasurement::fill(size_t graph_size, size_t network_size,
+                                  size_t queue_depth,
+                                  std::chrono::microseconds task_latency)
 {
     assert(not data_filled_);
     this->graph_size = graph_size;
     this->network_size = network_size;
+    this->queue_depth = queue_depth;
+    this->task_latency = task_latency;
     data_filled_ = true;
 }
 
@@ -28,7 +32,8 @@ void PerformanceMeasurement::setFinish()
 
 std::string PerformanceMeasurement::header()
 {
-    return "measurement,graph_size,network_size,duration";
+    return "measurement,graph_size,network_size,queue_depth,task_latency_us,"
+           "duration";
 }
 
 std::string PerformanceMeasurement::str() const
@@ -41,6 +46,8 @@ std::string PerformanceMeasurement::str() const
     return name + "," +
            std::to_string(graph_size) + "," +
            std::to_string(network_size) + "," +
+           std::to_string(queue_depth) + "," +
+           std::to_string(task_latency.count()) + "," +
            std::to_string(duration_ms.count());
 }
 
@@ -70,6 +77,7 @@ PerformanceMonitor::startMeasurement(std::string name,
     auto measurement = std::make_shared<PerformanceMeasurement>(
         name, connection_id, request_id
     );
+    std::lock_guard<std::mutex> lock(mutex_);
     measurement_map_.emplace(measurement->id, measurement);
     return measurement;
 }
@@ -78,6 +86,7 @@ void PerformanceMonitor::finishMeasurement(ConnectionId connection_id,
                                            RequestId request_id)
 {
     //std::cout<<"["<<request_id<<"] finish"<<std::endl;
+    std::lock_guard<std::mutex> lock(mutex_);
     auto it = measurement_map_.find({connection_id, request_id});
     if (it != measurement_map_.end()) {
         auto measurement = it->second;
@@ -93,6 +102,7 @@ void PerformanceMonitor::finishMeasurement(ConnectionId connection_id,
 
 void PerformanceMonitor::flush()
 {
+    std::lock_guard<std::mutex> lock(mutex_);
     if (save_results_) {
         for (auto measurement : measurements_to_write_) {
             measurement_file_ << measurement->str() << std::endl;
@@ -5,6 +5,7 @@
 
 #include <fstream>
 #include <map>
+#include <mutex>
 
 struct PerformanceMeasurement {
     using Id = std::pair<ConnectionId, RequestId>;
@@ -13,7 +14,8 @@ struct PerformanceMeasurement {
                                     ConnectionId connection_id,
                                     RequestId request_id);
 
-    void fill(size_t graph_size, size_t network_size);
+    void fill(size_t graph_size, size_t network_size,
+              size_t queue_depth, std::chrono::microseconds task_latency);
     void setFinish();
 
     static std::string header();
@@ -22,6 +24,9 @@ struct PerformanceMeasurement {
 
     size_t graph_size;
     size_t network_size;
+    // Detector backlog when the measurement was filled
+    size_t queue_depth;
+    std::chrono::microseconds task_latency;
     Timestamp::TimePoint start_time;
     Timestamp::Duration duration;
 
@@ -50,6 +55,8 @@ private:
     bool save_results_;
     std::string measurement_filename_;
     std::ofstream measurement_file_;
+    // Measurements are started and finished by the pipeline shards
+    std::mutex mutex_;
     std::map<PerformanceMeasurement::Id,
              PerformanceMeasurementPtr> measurement_map_;
     std::list<PerformanceMeasurementPtr> measurements_to_write_;
@@ -1,7 +1,10 @@
 #pragma once
 
+#include "MessageBuffer.hpp"
+
 #include <fluid/ofcommon/msg.hh>
 
+#include <cassert>
 #include <cstdint>
 #include <iostream>
 #include <memory>
@@ -23,8 +26,54 @@ constexpr Priority LOW_PRIORITY = 1u;
 
 using Cookie = uint64_t;
 constexpr Cookie ZERO_COOKIE = 0x0;
+constexpr Cookie EXACT_COOKIE_MASK = (Cookie)-1;
+// Interceptor cookies are tagged in the high bits, so all interceptors of
+// a switch are selected by one cookie mask
+constexpr Cookie INTERCEPTOR_COOKIE = 0xa000ull << 48;
+constexpr Cookie INTERCEPTOR_COOKIE_MASK = 0xffffull << 48;
+
+// Rules are ordered by switch, table, priority and sequence number. All
+// fields but the switch are packed into one word, so rule maps compare two
+// integers instead of a tuple
+class RuleId
+{
+    static constexpr int TABLE_SHIFT = 56;
+    static constexpr int PRIORITY_SHIFT = 40;
+    static constexpr uint64_t SEQ_MASK = (1ull << PRIORITY_SHIFT) - 1;
+
+public:
+    static constexpr uint64_t MAX_SEQ = SEQ_MASK;
+
+    RuleId(): switch_id_(0), key_(0) {}
+    RuleId(SwitchId switch_id, TableId table_id, Priority priority,
+           uint64_t seq):
+        switch_id_(switch_id),
+        key_((uint64_t)table_id << TABLE_SHIFT |
+             (uint64_t)priority << PRIORITY_SHIFT |
+             (seq & SEQ_MASK)) {
+        // Wider sequence numbers would change the rule order
+        assert(seq <= MAX_SEQ);
+    }
+
+    SwitchId switchId() const {return switch_id_;}
+    TableId tableId() const {return (TableId)(key_ >> TABLE_SHIFT);}
+    Priority priority() const {return (Priority)(key_ >> PRIORITY_SHIFT);}
+    uint64_t seq() const {return key_ & SEQ_MASK;}
+
+    bool operator==(const RuleId& other) const {
+        return switch_id_ == other.switch_id_ && key_ == other.key_;
+    }
+    bool operator!=(const RuleId& other) const {return not (*this == other);}
+    bool operator<(const RuleId& other) const {
+        return switch_id_ != other.switch_id_ ? switch_id_ < other.switch_id_
+                                              : key_ < other.key_;
+    }
+    bool operator>(const RuleId& other) const {return other < *this;}
 
-using RuleId = std::tuple<SwitchId, TableId, Priority, uint64_t>;
+private:
+    SwitchId switch_id_;
+    uint64_t key_;
+};
 
 template <typename IdType>
 class IdGenerator
@@ -68,24 +117,36 @@ struct PortStatsFields
     uint64_t collisions;   /* Number of collisions. */
 };
 
+// Copies of a raw message share its bytes
 struct RawMessage
 {
-    RawMessage(uint8_t type, void* raw_data, size_t len):
-        type(type), len(len), data_(reinterpret_cast<uint8_t*>(raw_data)) {}
+    RawMessage(): type(0u), len(0u) {}
+    RawMessage(uint8_t type, MessageBuffer buffer, size_t len):
+        type(type), len(len), buffer_(std::move(buffer)) {}
     RawMessage(fluid_msg::OFMsg& message):
-        RawMessage(message.type(), message.pack(), message.length())
+        type(message.type()), len(message.length())
     {
+        auto data = message.pack();
         // Workaround for the libfluid multipart.pack - it changes message len!
         auto fixed_len = message.length();
         len = (fixed_len > len) ? fixed_len : len;
+        buffer_ = MessageBuffer::adopt(data, len, &delete_packed);
     }
 
     uint8_t type;
     size_t len;
-    uint8_t* data() const {return data_.get();}
+    uint8_t* data() const {return buffer_.data();}
+    const MessageBuffer& buffer() const {return buffer_;}
+    // Default constructed messages carry no bytes
+    bool empty() const {return not buffer_;}
 
 private:
-    std::shared_ptr<uint8_t> data_;
+    MessageBuffer buffer_;
+
+    // Packed messages are allocated by libfluid with new[]
+    static void delete_packed(void* data) {
+        delete[] reinterpret_cast<uint8_t*>(data);
+    }
 };
 
 enum class Origin
@@ -104,15 +165,16 @@ struct Message {
     Message(ConnectionId connection_id, Origin origin,
             Destination destination, RawMessage raw_message):
         connection_id(connection_id), origin(origin), destination(destination),
-        raw_message(raw_message) {}
+        raw_message(std::move(raw_message)) {}
 
     Message(ConnectionId connection_id, Origin origin,
             RawMessage raw_message):
-        Message(connection_id, origin, get_destination(origin), raw_message) {}
+        Message(connection_id, origin, get_destination(origin),
+                std::move(raw_message)) {}
     Message(ConnectionId connection_id, Destination destination,
             RawMessage raw_message):
         Message(connection_id, get_origin(destination),
-                destination, raw_message) {}
+                destination, std::move(raw_message)) {}
 
     ConnectionId connection_id;
     Origin origin;
@@ -145,17 +207,20 @@ public:
         return queue_.size();
     }
 
+    // Every barrier keeps the segment before it, even an empty one, so the
+    // elements pushed after the barrier are not popped with the next segment
     void addBarrier() {
-        queue_.push(std::vector<Element>());
+        if (queue_.empty()) {
+            queue_.emplace();
+        }
+        queue_.emplace();
     }
 
     void push(Element&& element) {
         if (queue_.empty()) {
-            queue_.push(std::vector<Element>{std::move(element)});
-        }
-        else {
-            queue_.back().push_back(std::move(element));
+            queue_.emplace();
         }
+        queue_.back().push_back(std::move(element));
     }
 
     std::vector<Element> pop() {
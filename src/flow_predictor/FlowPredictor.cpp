@@ -2,7 +2,6 @@
 
 #include <algorithm>
 #include <memory>
-#include <queue>
 
 void Prediction::update(RuleStatsFields real, RuleStatsFields predicted)
 {
@@ -16,8 +15,10 @@ void Prediction::update(RuleStatsFields real, RuleStatsFields predicted)
 //}
 
 FlowPredictor::FlowPredictor(std::shared_ptr<DependencyGraph> dependency_graph,
-                             std::shared_ptr<RequestIdGenerator> xid_generator):
+                             std::shared_ptr<RequestIdGenerator> xid_generator,
+                             std::shared_ptr<WorkStealingPool> pool):
     dependency_graph_(dependency_graph),
+    pool_(std::move(pool)),
     path_scan_(std::make_unique<PathScan>()),
     interceptor_manager_(std::make_unique<InterceptorManager>()),
     stats_manager_(std::make_unique<StatsManager>(xid_generator))
@@ -27,25 +28,30 @@ FlowPredictor::FlowPredictor(std::shared_ptr<DependencyGraph> dependency_graph,
 
 Instruction FlowPredictor::getInstruction()
 {
-    path_scan_->clearDeletedNodes();
+    path_scan_->releaseNodes(stats_manager_->backTime());
+    // Paths that start and end within one timestamp never had an installed
+    // interceptor, so the timestamp must advance with every interceptor diff
+    auto interceptor_diff = interceptor_manager_->popInterceptorDiff();
+    auto network_changed = not interceptor_diff.empty();
     auto instruction = Instruction{
-        stats_manager_->getNewRequests(),
+        stats_manager_->getNewRequests(network_changed),
         create_replies(),
-        interceptor_manager_->popInterceptorDiff()
+        std::move(interceptor_diff)
     };
     return instruction;
 }
 
 void FlowPredictor::passRequest(RequestPtr request)
 {
-    auto rule_request = RuleRequest::pointerCast(request);
-    //std::cout<<"passRequest["<<request->time.id<<
-    //         "] "<<*(rule_request->rule.get())<<std::endl;
+    //std::cout<<"passRequest["<<request->time.id<<"]"<<std::endl;
     stats_manager_->passRequest(request);
+
+    // Buckets are completed in order, so one reply may complete several
     auto stats_list = stats_manager_->popStatsList();
-    if (not stats_list.stats.empty()) {
+    while (not stats_list.stats.empty()) {
         process_stats_list(std::move(stats_list.stats));
-        update_predictions(request->time.id);
+        update_predictions(stats_list.timestamp);
+        stats_list = stats_manager_->popStatsList();
     }
 }
 
@@ -63,8 +69,7 @@ void FlowPredictor::updateEdges(const EdgeDiff& edge_diff)
 
     //std::cout<<"[Graph] Change"<<std::endl;
     for (auto& changed_edge : edge_diff.changed_edges) {
-        delete_subtrees(changed_edge);
-        add_subtrees(changed_edge);
+        update_subtrees(changed_edge);
     }
 
     //std::cout<<"[Graph] Add"<<std::endl;
@@ -81,6 +86,7 @@ void FlowPredictor::updateEdges(const EdgeDiff& edge_diff)
 
 void FlowPredictor::predictFlow(RequestId request_id, std::list<RulePtr> rules)
 {
+    std::vector<NodePtr> roots;
     for (const auto& rule : rules) {
         // Create pending predictions
         //DEBUG//std::cout<<"Add pred: "<<current_time().id<<std::endl;
@@ -89,20 +95,42 @@ void FlowPredictor::predictFlow(RequestId request_id, std::list<RulePtr> rules)
         // TODO: Get rule stats for detection
         //stats_manager_->requestRule(rule);
 
-        // Create requests
-        auto nodes = path_scan_->getNodes(rule);
-        for (auto node : nodes) {
-            predict_subtree(node);
+        if (path_scan_->ruleExists(rule)) {
+            const auto& nodes = path_scan_->getNodes(rule);
+            roots.insert(roots.end(), nodes.begin(), nodes.end());
+        }
+    }
+
+    // Subtree walks only read the path scan, so workers collect source
+    // paths per chunk and requests are created in the sequential order
+    auto chunk_number =
+        (roots.size() + PREDICT_GRAIN_SIZE - 1) / PREDICT_GRAIN_SIZE;
+    std::vector<std::vector<DomainPathPtr>> chunk_paths(chunk_number);
+    auto predict_subtrees = [this, &roots, &chunk_paths]
+                            (size_t begin, size_t end) {
+        auto& source_paths = chunk_paths[begin / PREDICT_GRAIN_SIZE];
+        for (auto i = begin; i < end; i++) {
+            predict_subtree(roots[i], source_paths);
+        }
+    };
+    parallelFor(pool_.get(), roots.size(), PREDICT_GRAIN_SIZE,
+                predict_subtrees);
+
+    // Create requests
+    for (const auto& source_paths : chunk_paths) {
+        for (const auto& path : source_paths) {
+            stats_manager_->requestPath(path);
         }
     }
 }
 
-void FlowPredictor::predict_subtree(NodePtr root)
+void FlowPredictor::predict_subtree(
+    NodePtr root, std::vector<DomainPathPtr>& source_paths) const
 {
-    path_scan_->forEachSubtreeNode(root, [this, root](NodePtr node) {
-        auto rule = path_scan_->node(node).rule;
+    path_scan_->forEachSubtreeNode(root, [this, &source_paths](NodePtr node) {
+        const auto& rule = path_scan_->node(node).rule;
         if (rule->type() == RuleType::SOURCE) {
-            query_domain_path(node, root);
+            source_paths.push_back(path_scan_->outDomainPath(node));
         }
     });
 }
@@ -205,10 +233,8 @@ void FlowPredictor::process_path_query(const PathStatsPtr& query)
     auto source = path_scan_->domainPath(path).source;
     auto sink = path_scan_->domainPath(path).sink;
     path_scan_->forEachPathNode(source, sink,
-        [this, traversing_counter](NodePtr node) -> bool {
+        [this, traversing_counter](NodePtr node) {
             path_scan_->addNodeCounter(node, traversing_counter);
-            auto node_final_time = path_scan_->node(node).final_time_;
-            return node_final_time < current_time();
         }
     );
 
@@ -233,7 +259,8 @@ void FlowPredictor::add_subtrees(const Dependency& edge)
     if (path_scan_->ruleExists(dst_rule)) {
         auto dst_nodes = path_scan_->getNodes(dst_rule);
         for (auto dst_node : dst_nodes) {
-            auto result = add_child_node(dst_node, edge);
+            auto result = add_child_node(dst_node, edge.src,
+                                         edge.transfer, edge.domain);
             auto success = result.second;
             if (success) {
                 auto new_child = result.first;
@@ -246,51 +273,74 @@ void FlowPredictor::add_subtrees(const Dependency& edge)
 void FlowPredictor::delete_subtrees(const Dependency& edge)
 {
     //std::cout<<"[Path] delete_subtrees "<<edge.first<<std::endl;
-    auto src_rule = edge.src;
-    if (path_scan_->ruleExists(src_rule)) {
-        auto nodes = path_scan_->getNodes(src_rule);
-        for (auto node_it = nodes.begin(); node_it != nodes.end();) {
-            // Check correct edge
-            auto node = *node_it;
-            //std::cout << "[Path] --- node " << **node_it << std::endl;
-            if (node->parent->rule->id() == edge.dst->id()) {
-                delete_subtree(*node_it);
-            }
-            node_it++;
-        }
+    // Deletion changes the node list, so it is copied
+    auto nodes = path_scan_->getNodes(edge.src, edge.dst);
+    for (auto node : nodes) {
+        delete_subtree(node);
     }
 }
 
-bool FlowPredictor::is_existing_child(NodePtr parent,
-                                      const Dependency& edge) const
+void FlowPredictor::update_subtrees(const Dependency& edge)
 {
-    auto src_rule = edge.src;
-    for (auto child : path_scan_->getChildNodes(parent)) {
-        auto child_rule = path_scan_->node(child).rule;
-        if (src_rule->id() == child_rule->id()) {
-            return true;
+    auto dst_rule = edge.dst;
+    if (not path_scan_->ruleExists(dst_rule)) {
+        add_subtrees(edge);
+        return;
+    }
+
+    auto dst_nodes = path_scan_->getNodes(dst_rule);
+    for (auto dst_node : dst_nodes) {
+        auto child = path_scan_->getChildNode(dst_node, edge.src);
+        auto root_transfer = edge.transfer * dst_node->rootTransfer();
+        if (child && child->rootTransfer().isIdentical(root_transfer)) {
+            update_subtree(child, child_domain(dst_node, edge.src,
+                                               edge.transfer, edge.domain));
+            continue;
+        }
+
+        // Transfer has changed, so the subtree is rebuilt
+        if (child) {
+            delete_subtree(child);
+        }
+        auto result = add_child_node(dst_node, edge.src,
+                                     edge.transfer, edge.domain);
+        if (result.second) {
+            add_subtree(result.first);
         }
     }
-    return false;
+}
+
+NetworkSpace FlowPredictor::child_domain(NodePtr parent, RulePtr src_rule,
+                                         const Transfer& transfer,
+                                         const NetworkSpace& edge_domain) const
+{
+    const auto& parent_domain = path_scan_->node(parent).domain();
+    return transfer.inverse(edge_domain & parent_domain) & src_rule->domain();
+}
+
+bool FlowPredictor::is_same_domain(NodePtr node,
+                                   const NetworkSpace& domain) const
+{
+    // Semantic comparison does not handle lazy header differences, so a
+    // structural change is treated as a domain change
+    const auto& node_domain = path_scan_->node(node).domain();
+    return node_domain.isIdentical(domain);
 }
 
 std::pair<NodePtr, bool>
-FlowPredictor::add_child_node(NodePtr parent, const Dependency& edge)
+FlowPredictor::add_child_node(NodePtr parent, RulePtr src_rule,
+                              const Transfer& transfer,
+                              const NetworkSpace& edge_domain)
 {
-    auto parent_domain = path_scan_->node(parent).domain;
     auto parent_multiplier = path_scan_->node(parent).multiplier;
-    //auto edge_domain = dependency_graph_->edge(edge).domain;
-    auto edge_domain = edge.domain;
-
-    //auto rule = edge->src->rule;
-    auto rule = edge.src;
-    auto& transfer = edge.transfer;
-    auto domain =
-        transfer.inverse(edge_domain & parent_domain) & rule->domain();
+
+    auto rule = src_rule;
+    auto domain = child_domain(parent, rule, transfer, edge_domain);
     auto multiplier = rule->multiplier() * parent_multiplier;
 
     // Create node
-    if (not domain.empty() && not is_existing_child(parent, edge)) {
+    if (not domain.empty() &&
+            nullptr == path_scan_->getChildNode(parent, rule)) {
         auto new_node = path_scan_->addChildNode(
             parent, rule, std::move(domain), transfer, multiplier
         );
@@ -304,24 +354,25 @@ FlowPredictor::add_child_node(NodePtr parent, const Dependency& edge)
 void FlowPredictor::add_subtree(NodePtr subtree_root)
 {
     //DEBUG//std::cout<<"add_subtree: "<<*subtree_root<<std::endl;
-    std::queue<NodePtr> node_queue;
-    node_queue.push(subtree_root);
-    while (not node_queue.empty()) {
-        auto& node = node_queue.front();
+    auto& node_queue = subtree_queue_;
+    node_queue.clear();
+    node_queue.push_back(subtree_root);
+    for (size_t head = 0; head < node_queue.size(); head++) {
+        auto node = node_queue[head];
         //DEBUG//std::cout<<"-> "<<*node<<std::endl;
-        auto rule = path_scan_->node(node).rule;
+        const auto& rule = path_scan_->node(node).rule;
 
         // TODO: save path to getPort
 
         if (rule->type() != RuleType::SOURCE) {
             for (auto& edge : dependency_graph_->inEdges(rule)) {
                 // Save child nodes to the path scan
-                auto dependency = Dependency(edge);
-                auto result = add_child_node(node, dependency);
+                auto result = add_child_node(node, edge->src->rule,
+                                             edge->transfer, edge->domain);
                 auto success = result.second;
                 if (success) {
                     auto child_node = result.first;
-                    node_queue.push(child_node);
+                    node_queue.push_back(child_node);
                 }
             }
         }
@@ -329,7 +380,6 @@ void FlowPredictor::add_subtree(NodePtr subtree_root)
             auto root = path_scan_->node(subtree_root).root;
             add_domain_path(node, root);
         }
-        node_queue.pop();
     }
 }
 
@@ -353,11 +403,51 @@ void FlowPredictor::delete_subtree(NodePtr subtree_root)
     );
 }
 
-void FlowPredictor::query_domain_path(NodePtr source, NodePtr sink)
+void FlowPredictor::update_subtree(NodePtr subtree_root, NetworkSpace&& domain)
 {
-    auto path = path_scan_->outDomainPath(source);
-    stats_manager_->requestPath(path);
-    //DEBUG//std::cout<<"[Path] Query: "<<*path->interceptor<<std::endl;
+    // Nodes keep their versions while their domains stay the same, only
+    // nodes that lose or gain traffic are retired or spawned
+    auto& node_queue = update_queue_;
+    node_queue.clear();
+    node_queue.emplace_back(subtree_root, std::move(domain));
+    for (size_t head = 0; head < node_queue.size(); head++) {
+        auto node = node_queue[head].first;
+        auto new_domain = std::move(node_queue[head].second);
+        if (new_domain.empty()) {
+            delete_subtree(node);
+            continue;
+        }
+        if (is_same_domain(node, new_domain)) {
+            continue;
+        }
+        path_scan_->setNodeDomain(node, std::move(new_domain));
+
+        const auto& rule = path_scan_->node(node).rule;
+        if (rule->type() == RuleType::SOURCE) {
+            // Interceptor must match the new domain
+            auto root = path_scan_->node(node).root;
+            delete_domain_path(node, root);
+            add_domain_path(node, root);
+            continue;
+        }
+
+        for (auto& edge : dependency_graph_->inEdges(rule)) {
+            auto src_rule = edge->src->rule;
+            auto child = path_scan_->getChildNode(node, src_rule);
+            if (child) {
+                node_queue.emplace_back(child, child_domain(
+                    node, src_rule, edge->transfer, edge->domain
+                ));
+            }
+            else {
+                auto result = add_child_node(node, src_rule,
+                                             edge->transfer, edge->domain);
+                if (result.second) {
+                    add_subtree(result.first);
+                }
+            }
+        }
+    }
 }
 
 void FlowPredictor::add_domain_path(NodePtr source, NodePtr sink)
@@ -8,12 +8,14 @@
 #include "Stats.hpp"
 #include "../network/Network.hpp"
 #include "../network/Rule.hpp"
+#include "../ConcurrencyPrimitives.hpp"
 
 #include <deque>
 #include <map>
 #include <memory>
 #include <set>
 #include <unordered_map>
+#include <vector>
 
 struct Prediction
 {
@@ -49,8 +51,9 @@ struct Instruction
 class FlowPredictor
 {
 public:
-    explicit FlowPredictor(std::shared_ptr<DependencyGraph> dependency_graph,
-                           std::shared_ptr<RequestIdGenerator> xid_generator);
+    FlowPredictor(std::shared_ptr<DependencyGraph> dependency_graph,
+                  std::shared_ptr<RequestIdGenerator> xid_generator,
+                  std::shared_ptr<WorkStealingPool> pool = nullptr);
 
     Instruction getInstruction();
     void passRequest(RequestPtr request);
@@ -58,9 +61,14 @@ public:
     void predictFlow(RequestId request_id, std::list<RulePtr> rules);
 
     size_t pathScanSize() const {return path_scan_->size();}
+    bool requestsReady() const {return stats_manager_->requestsReady();}
+    bool instructionReady() const {
+        return not predictions_.empty() || stats_manager_->requestsExist();
+    }
 
 private:
     std::shared_ptr<DependencyGraph> dependency_graph_;
+    std::shared_ptr<WorkStealingPool> pool_;
     std::unique_ptr<PathScan> path_scan_;
     std::unique_ptr<InterceptorManager> interceptor_manager_;
     std::unique_ptr<StatsManager> stats_manager_;
@@ -69,9 +77,18 @@ private:
     PredictionList predictions_;
     std::unordered_map<TimestampId, PredictionList> pending_predictions_;
 
+    // Reused by add_subtree() and update_subtree() to avoid a queue
+    // allocation per subtree
+    std::vector<NodePtr> subtree_queue_;
+    std::vector<std::pair<NodePtr, NetworkSpace>> update_queue_;
+
+    // Subtrees are split into chunks of this size between pool workers
+    static constexpr size_t PREDICT_GRAIN_SIZE = 8;
+
     Timestamp current_time() const {return stats_manager_->frontTime();}
 
-    void predict_subtree(NodePtr root);
+    void predict_subtree(NodePtr root,
+                         std::vector<DomainPathPtr>& source_paths) const;
     void update_predictions(TimestampId timestamp);
     RuleReplyList create_replies();
 
@@ -80,15 +97,20 @@ private:
     void process_path_query(const PathStatsPtr& query);
     void process_link_query(const LinkStatsPtr& query);
 
-    bool is_existing_child(NodePtr parent, const Dependency& edge) const;
-    std::pair<NodePtr, bool> add_child_node(NodePtr parent,
-                                            const Dependency& edge);
+    NetworkSpace child_domain(NodePtr parent, RulePtr src_rule,
+                              const Transfer& transfer,
+                              const NetworkSpace& edge_domain) const;
+    bool is_same_domain(NodePtr node, const NetworkSpace& domain) const;
+    std::pair<NodePtr, bool> add_child_node(NodePtr parent, RulePtr src_rule,
+                                            const Transfer& transfer,
+                                            const NetworkSpace& edge_domain);
     void add_subtrees(const Dependency& edge);
     void delete_subtrees(const Dependency& edge);
+    void update_subtrees(const Dependency& edge);
     void add_subtree(NodePtr subtree_root);
     void delete_subtree(NodePtr subtree_root);
+    void update_subtree(NodePtr subtree_root, NetworkSpace&& domain);
 
-    void query_domain_path(NodePtr source, NodePtr sink);
     void add_domain_path(NodePtr source, NodePtr sink);
     void delete_domain_path(NodePtr source, NodePtr sink);
 };
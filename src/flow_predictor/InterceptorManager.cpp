@@ -79,10 +79,10 @@ std::string InterceptorManager::diffToString() const
 RulePtr InterceptorManager::new_interceptor(DomainPathPtr path) const
 {
     auto priority = get_priority(path);
-    Cookie cookie = 0xa000 + path->id;
+    Cookie cookie = INTERCEPTOR_COOKIE | path->id;
     auto domain = path->source_domain;
 
-    auto rule = std::make_shared<Rule>(
+    auto rule = makeRule(
         RuleType::SOURCE, path->source->rule->sw(), nullptr,
         priority, cookie, std::move(domain), Actions::tableAction(1u));
     return rule;
@@ -5,13 +5,17 @@
 
 #include <cstdint>
 #include <list>
+#include <unordered_map>
+#include <vector>
 
 using NodeId = uint64_t;
+using NodeIndex = uint32_t;
 using PathId = uint64_t;
 
+class Rule;
+
 struct Node;
-using NodePtr = std::list<Node>::iterator;
-using NodeRemovalIterator = std::list<NodePtr>::iterator;
+using NodePtr = Node*;
 
 struct DomainPath;
 using DomainPathPtr = std::list<DomainPath>::iterator;
@@ -21,11 +25,15 @@ using InterceptorPtr = std::list<Interceptor>::iterator;
 
 struct RuleMapping
 {
-    RuleMapping(): counter({0, 0}), final_time(Timestamp::max()) {}
-    bool empty() const {return node_list.empty();}
+    RuleMapping(): counter({0, 0}), old_node_number(0u),
+                   final_time(Timestamp::max()) {}
+    bool empty() const {return node_list.empty() && 0u == old_node_number;}
 
     RuleStatsFields counter;
-    std::list<NodePtr> node_list;
+    std::vector<NodePtr> node_list;
+    // Current nodes grouped by the rule of their parent node
+    std::unordered_map<const Rule*, std::vector<NodePtr>> parent_rule_nodes;
+    uint32_t old_node_number;
     Timestamp final_time;
 };
 using RuleMappingDescriptor = std::list<RuleMapping>::iterator;
@@ -1,12 +1,13 @@
 #include "PathScan.hpp"
 
-#include <queue>
 
-Node::Node(NodeId id, RulePtr rule, NetworkSpace&& domain,
-           Transfer root_transfer, uint64_t multiplier):
-    id(id), rule(rule), domain(std::move(domain)),
-    root_transfer(std::move(root_transfer)), multiplier(multiplier),
-    counter({0, 0}), final_time_(Timestamp::max())
+Node::Node(NodeId id, RulePtr rule, const NodeSpace* space,
+           uint64_t multiplier):
+    id(id), root(nullptr), parent(nullptr), first_child(nullptr),
+    last_child(nullptr), next_sibling(nullptr), prev_sibling(nullptr),
+    rule(rule), space(space), multiplier(multiplier),
+    counter({0, 0}), rule_position_(0), parent_position_(0), pool_index_(0),
+    final_time_(Timestamp::max())
 {
 
 }
@@ -15,7 +16,7 @@ std::ostream& operator<<(std::ostream& os, const Node& node)
 {
     auto type = node.rule->type() == RuleType::SOURCE ? "SOURCE" : "FLOW";
     std::string children = "(";
-    for (auto child : node.children_) {
+    for (auto child = node.first_child; child; child = child->next_sibling) {
         children += std::to_string(child->id) + ",";
     }
     //if (not node.children_.empty()) {
@@ -27,16 +28,35 @@ std::ostream& operator<<(std::ostream& os, const Node& node)
        << ": id=" << node.id
        << ", parent=" << node.parent->id
        << ", child=" << children
-       << ", domain=" << node.domain
+       << ", domain=" << node.domain()
        << ", mult=" << node.multiplier
        << "]";
     return os;
 }
 
+NodePool::~NodePool()
+{
+    for (NodeIndex index = 0; index < next_index_; index++) {
+        if (live_[index]) {
+            static_cast<NodePtr>(slot(index))->~Node();
+        }
+    }
+}
+
+void NodePool::destroy(NodePtr node)
+{
+    auto index = node->pool_index_;
+    assert(live_[index]);
+    node->~Node();
+    live_[index] = false;
+    free_indices_.push_back(index);
+    size_--;
+}
+
 DomainPath::DomainPath(PathId id, NodePtr source, NodePtr sink,
                        Timestamp starting_time):
-    id(id), source(source), sink(sink), source_domain(source->domain),
-    sink_domain(source->root_transfer.apply(source_domain)),
+    id(id), source(source), sink(sink), source_domain(source->domain()),
+    sink_domain(source->rootTransfer().apply(source_domain)),
     last_counter({0, 0}), starting_time(starting_time),
     final_time(Timestamp::max())
 {
@@ -63,50 +83,40 @@ RuleStatsFields PathScan::addNodeCounter(NodePtr node,
     return node->counter;
 }
 
-void PathScan::forEachSubtreeNode(NodePtr root, NodeVisitor visitor)
+const std::vector<NodePtr>& PathScan::getNodes(RulePtr rule,
+                                               RulePtr parent_rule) const
 {
-    std::queue<NodePtr> node_queue;
-    node_queue.push(root);
-    while (not node_queue.empty()) {
-        // Save child nodes to the queue
-        auto& node = node_queue.front();
-        auto rule = node->rule;
-        if (rule->type() != RuleType::SOURCE) {
-            // Save child nodes to the queue
-            const auto& children = node->children_;
-            for (auto child_node : children) {
-                node_queue.push(child_node);
-            }
-        }
-
-        // Visit node
-        visitor(node);
-
-        node_queue.pop();
+    static const std::vector<NodePtr> empty_node_list;
+    if (not ruleExists(rule)) {
+        return empty_node_list;
     }
+    const auto& parent_rule_nodes = rule->rule_mapping_->parent_rule_nodes;
+    auto it = parent_rule_nodes.find(parent_rule.get());
+    return parent_rule_nodes.end() != it ? it->second : empty_node_list;
 }
 
-void PathScan::forEachPathNode(NodePtr source, NodePtr sink,
-                               NodeDeletingVisitor deleting_visitor)
+NodePtr PathScan::getChildNode(NodePtr parent, RulePtr rule) const
 {
-    std::queue<NodePtr> node_queue;
-    node_queue.push(source);
-    while (not node_queue.empty()) {
-        // Save the parent node to the queue
-        auto& node = node_queue.front();
-        auto rule = node->rule;
-        if (node->id != sink->id && rule->type() != RuleType::SINK) {
-            node_queue.push(node->parent);
-        }
+    auto it = child_index_.find({parent, rule.get()});
+    return child_index_.end() != it ? it->second : nullptr;
+}
 
-        // Visit node
-        if (deleting_visitor(node)) {
-            //deleteNode(node);
-            deleted_nodes_.insert(node);
-        }
+thread_local std::vector<std::vector<NodePtr>> PathScan::free_queues_;
 
-        node_queue.pop();
+std::vector<NodePtr> PathScan::acquire_queue()
+{
+    if (free_queues_.empty()) {
+        return std::vector<NodePtr>();
     }
+    auto queue = std::move(free_queues_.back());
+    free_queues_.pop_back();
+    return queue;
+}
+
+void PathScan::release_queue(std::vector<NodePtr>&& queue)
+{
+    queue.clear();
+    free_queues_.push_back(std::move(queue));
 }
 
 NodePtr PathScan::addRootNode(RulePtr rule)
@@ -116,9 +126,8 @@ NodePtr PathScan::addRootNode(RulePtr rule)
     auto multiplier = (uint64_t)1;
     auto root_transfer = Transfer::portTransfer(domain.inPort());
     auto node = add_node(rule, std::move(domain),
-                         root_transfer, multiplier);
+                         std::move(root_transfer), multiplier);
     node->root = node;
-    node->parent = NodePtr(nullptr);
     return node;
 }
 
@@ -129,56 +138,109 @@ NodePtr PathScan::addChildNode(NodePtr parent, RulePtr rule,
 {
     assert(RuleType::SINK != rule->type());
     // TODO: CRITICAL - flows may merge into one flow, there is no interceptor!
-    auto root_transfer = transfer * parent->root_transfer;
+    auto root_transfer = transfer * parent->rootTransfer();
     auto node = add_node(rule, std::move(domain),
-                         root_transfer, multiplier);
+                         std::move(root_transfer), multiplier);
     node->root = parent->root;
     node->parent = parent;
-    node->parent_backward_iterator_ = parent->children_.emplace(
-        parent->children_.end(), node
-    );
+
+    // Append the node to the child list of the parent
+    node->prev_sibling = parent->last_child;
+    if (parent->last_child) {
+        parent->last_child->next_sibling = node;
+    }
+    else {
+        parent->first_child = node;
+    }
+    parent->last_child = node;
+
+    // Index the node by its parent
+    auto& parent_nodes =
+        rule->rule_mapping_->parent_rule_nodes[parent->rule.get()];
+    node->parent_position_ = (uint32_t)parent_nodes.size();
+    parent_nodes.push_back(node);
+    auto result = child_index_.emplace(ChildKey(parent, rule.get()), node);
+    assert(result.second);
+    (void)result;
     return node;
 }
 
+void PathScan::setNodeDomain(NodePtr node, NetworkSpace&& domain)
+{
+    // Node counts the traffic of its current domain, the earlier traffic
+    // stays in the rule counter
+    node->counter = RuleStatsFields{0u, 0u};
+    auto old_space = node->space;
+    auto root_transfer = old_space->root_transfer;
+    node->space = acquire_space(std::move(domain), std::move(root_transfer));
+    release_space(old_space);
+}
+
 void PathScan::setNodeFinalTime(NodePtr node, Timestamp final_time)
 {
     //std::cout<<"[Path] setNodeFinalTime: "<<node->id<<std::endl;
     // Node version becomes old
     assert(Timestamp::max() != final_time);
     node->final_time_ = final_time;
+    if (old_nodes_.empty() || old_nodes_.back().first != final_time.id) {
+        assert(old_nodes_.empty() || old_nodes_.back().first < final_time.id);
+        old_nodes_.emplace_back(final_time.id, std::vector<NodePtr>());
+    }
+    old_nodes_.back().second.push_back(node);
 
     // Remove node from corresponding vertex
-    auto mapping = node->rule->rule_mapping_;
-    auto mapping_it = node->vertex_backward_iterator_;
-    assert(NodeRemovalIterator(nullptr) != mapping_it);
-    mapping->node_list.erase(mapping_it);
+    auto& node_list = node->rule->rule_mapping_->node_list;
+    auto position = node->rule_position_;
+    assert(position < node_list.size() && node == node_list[position]);
+    node_list[position] = node_list.back();
+    node_list[position]->rule_position_ = position;
+    node_list.pop_back();
+    node->rule->rule_mapping_->old_node_number++;
 
     // Remove node from the parent if it's not a root
     if (RuleType::SINK != node->rule->type()) {
         auto parent = node->parent;
-        auto parent_it = node->parent_backward_iterator_;
-        assert(NodeRemovalIterator(nullptr) != parent_it);
-        parent->children_.erase(parent_it);
-    }
-}
-
-void PathScan::deleteNode(NodePtr node)
-{
-    //std::cout<<"[Path] deleteNode: "<<node->id<<std::endl;
-    // We must delete only old versions
-    assert(Timestamp::max() != node->final_time_);
-    if (node->rule->rule_mapping_->empty()) {
-        delete_rule_mapping(node->rule);
+        if (node->prev_sibling) {
+            node->prev_sibling->next_sibling = node->next_sibling;
+        }
+        else {
+            parent->first_child = node->next_sibling;
+        }
+        if (node->next_sibling) {
+            node->next_sibling->prev_sibling = node->prev_sibling;
+        }
+        else {
+            parent->last_child = node->prev_sibling;
+        }
+        node->next_sibling = node->prev_sibling = nullptr;
+
+        // Remove node from the parent indices
+        auto& parent_rule_nodes = node->rule->rule_mapping_->parent_rule_nodes;
+        auto it = parent_rule_nodes.find(parent->rule.get());
+        auto& parent_nodes = it->second;
+        auto parent_position = node->parent_position_;
+        assert(parent_position < parent_nodes.size() &&
+               node == parent_nodes[parent_position]);
+        parent_nodes[parent_position] = parent_nodes.back();
+        parent_nodes[parent_position]->parent_position_ = parent_position;
+        parent_nodes.pop_back();
+        if (parent_nodes.empty()) {
+            parent_rule_nodes.erase(it);
+        }
+        child_index_.erase(ChildKey(parent, node->rule.get()));
     }
-    node_list_.erase(node);
 }
 
-void PathScan::clearDeletedNodes()
+void PathScan::releaseNodes(Timestamp oldest_stats_time)
 {
-    for (auto& node : deleted_nodes_) {
-        deleteNode(node);
+    // Released slots are reused by the next created nodes
+    while (not old_nodes_.empty() &&
+           old_nodes_.front().first < oldest_stats_time.id) {
+        for (auto node : old_nodes_.front().second) {
+            delete_node(node);
+        }
+        old_nodes_.pop_front();
     }
-    deleted_nodes_.clear();
 }
 
 const DomainPath& PathScan::domainPath(DomainPathPtr desc) const
@@ -216,6 +278,60 @@ void PathScan::deleteDomainPath(DomainPathPtr path)
 
 }
 
+const NodeSpace* PathScan::acquire_space(NetworkSpace&& domain,
+                                         Transfer&& root_transfer)
+{
+    // Spaces are compared structurally, which is exact for spaces that
+    // were computed in the same way along symmetric paths
+    auto hash = domain.hash() * 31u + root_transfer.hash();
+
+    NodeSpace* space = nullptr;
+    auto range = node_spaces_.equal_range(hash);
+    for (auto it = range.first; it != range.second; it++) {
+        auto& candidate = it->second;
+        if (candidate->domain.isIdentical(domain) &&
+                candidate->root_transfer.isIdentical(root_transfer)) {
+            space = candidate.get();
+            break;
+        }
+    }
+    if (not space) {
+        auto it = node_spaces_.emplace(hash, std::make_unique<NodeSpace>(
+            std::move(domain), std::move(root_transfer), hash
+        ));
+        space = it->second.get();
+    }
+    space->ref_count++;
+    return space;
+}
+
+void PathScan::release_space(const NodeSpace* space)
+{
+    assert(space->ref_count > 0u);
+    auto range = node_spaces_.equal_range(space->hash);
+    for (auto it = range.first; it != range.second; it++) {
+        if (it->second.get() == space) {
+            if (0u == --it->second->ref_count) {
+                node_spaces_.erase(it);
+            }
+            return;
+        }
+    }
+}
+
+void PathScan::delete_node(NodePtr node)
+{
+    //std::cout<<"[Path] delete_node: "<<node->id<<std::endl;
+    // We must delete only old versions
+    assert(Timestamp::max() != node->final_time_);
+    node->rule->rule_mapping_->old_node_number--;
+    if (node->rule->rule_mapping_->empty()) {
+        delete_rule_mapping(node->rule);
+    }
+    release_space(node->space);
+    node_pool_.destroy(node);
+}
+
 RuleMappingDescriptor PathScan::add_rule_mapping(RulePtr rule)
 {
     assert(RuleMappingDescriptor(nullptr) == rule->rule_mapping_);
@@ -233,14 +349,11 @@ void PathScan::delete_rule_mapping(RulePtr rule)
 }
 
 NodePtr PathScan::add_node(RulePtr rule, NetworkSpace&& domain,
-                                  const Transfer& root_transfer,
-                                  uint64_t multiplier)
+                           Transfer&& root_transfer, uint64_t multiplier)
 {
     // Create node
-    auto node = node_list_.emplace(node_list_.end(),
-        last_node_id_++, rule, std::move(domain),
-        root_transfer, multiplier
-    );
+    auto space = acquire_space(std::move(domain), std::move(root_transfer));
+    auto node = node_pool_.create(last_node_id_++, rule, space, multiplier);
     //std::cout<<"[Path] add_node: "<<node->id<<std::endl;
 
     // Create vertex
@@ -249,10 +362,8 @@ NodePtr PathScan::add_node(RulePtr rule, NetworkSpace&& domain,
     }
 
     // Adjust vertex
-    auto mapping = rule->rule_mapping_;
-    auto mapping_it = mapping->node_list.emplace(
-        mapping->node_list.end(), node
-    );
-    node->vertex_backward_iterator_ = mapping_it;
+    auto& node_list = rule->rule_mapping_->node_list;
+    node->rule_position_ = (uint32_t)node_list.size();
+    node_list.push_back(node);
     return node;
 }
@@ -7,29 +7,56 @@
 #include "../network/Network.hpp"
 #include "../network/Rule.hpp"
 
+#include <deque>
 #include <functional>
 #include <map>
 #include <memory>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+// Nodes with equal domains and root transfers share a single reference
+// counted copy. A node that changes its domain moves to another copy, and
+// only the spaces are shared, each node keeps its own subtree and counter
+struct NodeSpace
+{
+    NodeSpace(NetworkSpace&& domain, Transfer&& root_transfer,
+              size_t hash = 0):
+        domain(std::move(domain)), root_transfer(std::move(root_transfer)),
+        hash(hash), ref_count(0u) {}
+
+    NetworkSpace domain;
+    Transfer root_transfer;
+    size_t hash;
+    uint32_t ref_count;
+};
 
 struct Node
 {
-    Node(NodeId id, RulePtr rule, NetworkSpace&& domain,
-         Transfer root_transfer, uint64_t multiplier);
+    Node(NodeId id, RulePtr rule, const NodeSpace* space,
+         uint64_t multiplier);
     Node(Node&& other) noexcept = default;
 
     Node& operator=(Node&& other) noexcept = default;
     friend std::ostream& operator<<(std::ostream& os, const Node& node);
 
+    // Tree links are kept together at the beginning of the node, so
+    // traversals do not touch domains and transfers
     NodeId id;
     NodePtr root;
     NodePtr parent;
-    std::list<NodePtr> children_;
+    NodePtr first_child;
+    NodePtr last_child;
+    NodePtr next_sibling;
+    NodePtr prev_sibling;
 
     RulePtr rule;
-    NetworkSpace domain;
-    Transfer root_transfer;
+    const NodeSpace* space;
     uint64_t multiplier;
 
+    const NetworkSpace& domain() const {return space->domain;}
+    const Transfer& rootTransfer() const {return space->root_transfer;}
+
     //RuleStatsFields addCounter(RuleStatsFields new_counter) {
     //    //rule_mapping->counter += new_counter;
     //    //return counter += new_counter;
@@ -46,16 +73,92 @@ struct Node
     RuleStatsFields counter;
 
     RuleMappingDescriptor rule_mapping;
-    NodeRemovalIterator parent_backward_iterator_;
-    NodeRemovalIterator vertex_backward_iterator_;
+    uint32_t rule_position_;
+    uint32_t parent_position_;
+    NodeIndex pool_index_;
     Timestamp final_time_;
     DomainPathPtr out_path_;
+};
+
+class ChildRange
+{
+public:
+    class Iterator
+    {
+    public:
+        explicit Iterator(NodePtr node): node_(node) {}
 
-    struct PtrComparator {
-        bool operator()(NodePtr first, NodePtr second) const {
-            return first->id < second->id;
+        bool operator!=(const Iterator& other) const {
+            return node_ != other.node_;
         }
+        Iterator& operator++() {
+            node_ = node_->next_sibling;
+            return *this;
+        }
+        NodePtr operator*() const {return node_;}
+
+    private:
+        NodePtr node_;
     };
+
+    explicit ChildRange(NodePtr parent): first_(parent->first_child) {}
+
+    bool empty() const {return nullptr == first_;}
+    Iterator begin() const {return Iterator(first_);}
+    Iterator end() const {return Iterator(nullptr);}
+
+private:
+    NodePtr first_;
+};
+
+// Nodes are allocated in fixed-size chunks and addressed by 32-bit slot
+// indices. Node pointers stay valid while the pool grows, and released
+// slots are reused by new nodes before the pool grows again
+class NodePool
+{
+public:
+    NodePool(): next_index_(0), size_(0) {}
+    NodePool(const NodePool& other) = delete;
+    NodePool& operator=(const NodePool& other) = delete;
+    ~NodePool();
+
+    template<class... Args>
+    NodePtr create(Args&&... args) {
+        NodeIndex index;
+        if (not free_indices_.empty()) {
+            index = free_indices_.back();
+            free_indices_.pop_back();
+        }
+        else {
+            if (next_index_ % CHUNK_SIZE == 0) {
+                chunks_.emplace_back(new Slot[CHUNK_SIZE]);
+                live_.resize(live_.size() + CHUNK_SIZE, false);
+            }
+            index = next_index_++;
+        }
+        auto node = new (slot(index)) Node(std::forward<Args>(args)...);
+        node->pool_index_ = index;
+        live_[index] = true;
+        size_++;
+        return node;
+    }
+    void destroy(NodePtr node);
+
+    size_t size() const {return size_;}
+
+private:
+    static constexpr NodeIndex CHUNK_SIZE = 4096;
+    using Slot = std::aligned_storage<sizeof(Node), alignof(Node)>::type;
+
+    std::vector<std::unique_ptr<Slot[]>> chunks_;
+    std::vector<bool> live_;
+    std::vector<NodeIndex> free_indices_;
+    NodeIndex next_index_;
+    size_t size_;
+
+    void* slot(NodeIndex index) {
+        return &chunks_[index / CHUNK_SIZE][index % CHUNK_SIZE];
+    }
 };
 
 struct DomainPath
@@ -86,37 +189,46 @@ private:
 class PathScan
 {
 public:
-    using NodeVisitor = std::function<void(NodePtr node)>;
-    using NodeDeletingVisitor = std::function<bool(NodePtr node)>;
-
     PathScan(): last_node_id_(0), last_path_id_(1) {}
 
     bool ruleExists(RulePtr rule) const {
-        return RuleMappingDescriptor(nullptr) != rule->rule_mapping_;
+        return RuleMappingDescriptor(nullptr) != rule->rule_mapping_ &&
+               not rule->rule_mapping_->node_list.empty();
     }
     const Node& node(NodePtr desc) const {return *desc;}
-    const std::list<NodePtr>& getNodes(RulePtr rule) const {
+    const std::vector<NodePtr>& getNodes(RulePtr rule) const {
         return rule->rule_mapping_->node_list;
     }
-    const std::list<NodePtr>& getChildNodes(NodePtr node) const {
-        return node->children_;
+    // Nodes of the rule that are children of the parent rule nodes
+    const std::vector<NodePtr>& getNodes(RulePtr rule,
+                                         RulePtr parent_rule) const;
+    ChildRange getChildNodes(NodePtr node) const {
+        return ChildRange(node);
     }
+    NodePtr getChildNode(NodePtr parent, RulePtr rule) const;
     RuleStatsFields getRuleCounter(RulePtr rule) const {
         return rule->rule_mapping_->counter;
     }
     RuleStatsFields addNodeCounter(NodePtr node, RuleStatsFields new_counter);
 
-    void forEachSubtreeNode(NodePtr root, NodeVisitor visitor);
+    // Visitor is called as visitor(NodePtr) in breadth-first order
+    template<class Visitor>
+    void forEachSubtreeNode(NodePtr root, Visitor&& visitor) const;
+    // Visitor is called as visitor(NodePtr) from the source up to the sink
+    template<class Visitor>
     void forEachPathNode(NodePtr source, NodePtr sink,
-                         NodeDeletingVisitor deleting_visitor);
+                         Visitor&& visitor) const;
 
     NodePtr addRootNode(RulePtr rule);
     NodePtr addChildNode(NodePtr parent, RulePtr rule,
                                 NetworkSpace&& domain, const Transfer& transfer,
                                 uint64_t multiplier);
+    // Counter of the node is reset with its domain
+    void setNodeDomain(NodePtr node, NetworkSpace&& domain);
     void setNodeFinalTime(NodePtr node, Timestamp final_time);
-    void deleteNode(NodePtr node);
-    void clearDeletedNodes();
+    // Old nodes are kept while there may be unprocessed stats that traverse
+    // them, so only nodes finalized before the oldest stats are deleted
+    void releaseNodes(Timestamp oldest_stats_time);
 
     const DomainPath& domainPath(DomainPathPtr desc) const;
     DomainPathPtr outDomainPath(NodePtr source) const;
@@ -127,20 +239,80 @@ public:
                                 Timestamp final_time);
     void deleteDomainPath(DomainPathPtr path);
 
-    size_t size() const {return node_list_.size();}
+    size_t size() const {return node_pool_.size();}
+    size_t spaceNumber() const {return node_spaces_.size();}
 
 private:
     std::list<RuleMapping> rule_mapping_list_;
-    std::list<Node> node_list_;
+    std::unordered_multimap<size_t, std::unique_ptr<NodeSpace>> node_spaces_;
+    NodePool node_pool_;
     std::list<DomainPath> domain_path_list_;
-    std::set<NodePtr, Node::PtrComparator> deleted_nodes_;
+    // Old nodes grouped by their final time, in increasing order
+    std::deque<std::pair<TimestampId, std::vector<NodePtr>>> old_nodes_;
+
+    using ChildKey = std::pair<NodePtr, const Rule*>;
+    struct ChildKeyHash {
+        size_t operator()(const ChildKey& key) const {
+            return std::hash<NodePtr>{}(key.first) * 31u +
+                   std::hash<const Rule*>{}(key.second);
+        }
+    };
+    std::unordered_map<ChildKey, NodePtr, ChildKeyHash> child_index_;
     NodeId last_node_id_;
     PathId last_path_id_;
 
+    // Traversal queues are reused between calls. They are thread local, so
+    // concurrent read-only traversals do not share them, and a visitor may
+    // start a nested traversal
+    static thread_local std::vector<std::vector<NodePtr>> free_queues_;
+    static std::vector<NodePtr> acquire_queue();
+    static void release_queue(std::vector<NodePtr>&& queue);
+
+    const NodeSpace* acquire_space(NetworkSpace&& domain,
+                                   Transfer&& root_transfer);
+    void release_space(const NodeSpace* space);
+    void delete_node(NodePtr node);
+
     RuleMappingDescriptor add_rule_mapping(RulePtr rule);
     void delete_rule_mapping(RulePtr rule);
     NodePtr add_node(RulePtr rule, NetworkSpace&& domain,
-                            const Transfer& root_transfer,
-                            uint64_t multiplier);
+                     Transfer&& root_transfer, uint64_t multiplier);
 
 };
+
+template<class Visitor>
+void PathScan::forEachSubtreeNode(NodePtr root, Visitor&& visitor) const
+{
+    auto node_queue = acquire_queue();
+    node_queue.push_back(root);
+    for (size_t head = 0; head < node_queue.size(); head++) {
+        auto node = node_queue[head];
+        if (node->rule->type() != RuleType::SOURCE) {
+            // Save child nodes to the queue
+            for (auto child = node->first_child; child;
+                 child = child->next_sibling) {
+                node_queue.push_back(child);
+            }
+        }
+
+        // Visit node
+        visitor(node);
+    }
+    release_queue(std::move(node_queue));
+}
+
+template<class Visitor>
+void PathScan::forEachPathNode(NodePtr source, NodePtr sink,
+                               Visitor&& visitor) const
+{
+    auto node = source;
+    while (nullptr != node) {
+        bool is_last = node->id == sink->id ||
+                       node->rule->type() == RuleType::SINK;
+
+        // Visit node
+        visitor(node);
+
+        node = is_last ? nullptr : node->parent;
+    }
+}
@@ -1,6 +1,7 @@
 #include "Stats.hpp"
 
 #include <memory>
+#include <unordered_set>
 
 StatsDescriptor StatsBucket::addStats(StatsPtr stats)
 {
@@ -16,6 +17,10 @@ void StatsBucket::deleteStats(StatsDescriptor stats_desc)
 RequestList StatsBucket::getRequests()
 {
     RequestList requests;
+    // Path stats of a switch are coalesced into one interceptor request, and
+    // an interceptor shared by several path stats is requested once
+    std::unordered_map<SwitchId, InterceptorRequestPtr> interceptor_requests;
+    std::unordered_set<Cookie> requested_interceptors;
     for (const auto& stats : stats_list_) {
         auto time = stats->time;
         if (auto rule_stats = std::dynamic_pointer_cast<RuleStats>(stats))
@@ -23,19 +28,23 @@ RequestList StatsBucket::getRequests()
             auto id = xid_generator_->getId();
             requests.addRuleRequest(id, RequestType::RULE, time,
                                     rule_stats->rule->info());
-            expected_requests_.emplace(id, rule_stats);
+            expected_requests_[id].push_back(rule_stats);
         }
         else if (auto path_stats = std::dynamic_pointer_cast<PathStats>(stats))
         {
-            auto src_id = xid_generator_->getId();
-            //auto dst_id = xid_generator_->getId();
-            // TODO: refactor and create an interceptor request
-            requests.addRuleRequest(src_id, RequestType::SOURCE_RULE, time,
-                                    path_stats->path->interceptor);
-            //requests.addRuleRequest(dst_id, RequestType::SINK_RULE, time,
-            //                        path_stats->sink_interceptor);
-            expected_requests_.emplace(src_id, path_stats);
-            //expected_requests_.emplace(dst_id, path_stats);
+            auto interceptor = path_stats->path->interceptor;
+            assert(interceptor);
+            auto& request = interceptor_requests[interceptor->switch_id];
+            if (not request) {
+                request = std::make_shared<InterceptorRequest>(
+                    xid_generator_->getId(), time, interceptor->switch_id
+                );
+                requests.data.emplace_back(request);
+            }
+            if (requested_interceptors.insert(interceptor->cookie).second) {
+                request->interceptors.push_back(interceptor);
+            }
+            expected_requests_[request->id].push_back(path_stats);
         }
         else if (auto link_stats = std::dynamic_pointer_cast<LinkStats>(stats))
         {
@@ -45,8 +54,8 @@ RequestList StatsBucket::getRequests()
                                     link_stats->src_port);
             requests.addPortRequest(dst_id, RequestType::DST_PORT, time,
                                     link_stats->dst_port);
-            expected_requests_.emplace(src_id, link_stats);
-            expected_requests_.emplace(dst_id, link_stats);
+            expected_requests_[src_id].push_back(link_stats);
+            expected_requests_[dst_id].push_back(link_stats);
         }
         else {
             assert(0);
@@ -57,7 +66,10 @@ RequestList StatsBucket::getRequests()
 
 void StatsBucket::passRequest(RequestPtr request)
 {
-    if (auto rule_request = RuleRequest::pointerCast(request)) {
+    if (auto interceptor_request = InterceptorRequest::pointerCast(request)) {
+        pass_interceptor_request(interceptor_request);
+    }
+    else if (auto rule_request = RuleRequest::pointerCast(request)) {
         pass_rule_request(rule_request);
     }
     else if (auto port_request = PortRequest::pointerCast(request)) {
@@ -68,61 +80,83 @@ void StatsBucket::passRequest(RequestPtr request)
     }
 }
 
-StatsPtr StatsBucket::get_stats(RequestId id)
+std::vector<StatsPtr> StatsBucket::pop_stats(RequestId id)
 {
     auto it = expected_requests_.find(id);
     assert(it != expected_requests_.end());
-    StatsPtr stats = it->second;
+    auto stats_list = std::move(it->second);
     expected_requests_.erase(it);
-    return stats;
+    return stats_list;
 }
 
-void StatsBucket::pass_rule_request(RuleRequestPtr request)
+void StatsBucket::pass_interceptor_request(InterceptorRequestPtr request)
 {
-    auto stats = get_stats(request->id);
-    if (auto rule_stats = std::dynamic_pointer_cast<RuleStats>(stats)) {
-        assert(request->type == RequestType::RULE);
-        rule_stats->stats_fields = request->stats;
+    const auto& interceptor_stats = request->interceptor_stats;
+    for (const auto& stats : pop_stats(request->id)) {
+        auto path_stats = std::dynamic_pointer_cast<PathStats>(stats);
+        assert(path_stats != nullptr);
+        // An interceptor that is absent in the reply has not been installed
+        // yet, so it has not counted any packets
+        auto it = interceptor_stats.find(path_stats->path->interceptor->cookie);
+        if (interceptor_stats.end() != it) {
+            path_stats->source_stats_fields = it->second;
+        }
     }
-    else if (auto path_stats = std::dynamic_pointer_cast<PathStats>(stats)) {
-        switch (request->type) {
-        case RequestType::SOURCE_RULE:
-            path_stats->source_stats_fields = request->stats;
-            break;
-        case RequestType::SINK_RULE:
-            path_stats->sink_stats_fields = request->stats;
-            break;
-        default:
+}
+
+void StatsBucket::pass_rule_request(RuleRequestPtr request)
+{
+    for (const auto& stats : pop_stats(request->id)) {
+        if (auto rule_stats = std::dynamic_pointer_cast<RuleStats>(stats)) {
+            assert(request->type == RequestType::RULE);
+            rule_stats->stats_fields = request->stats;
+        }
+        else if (auto path_stats =
+                 std::dynamic_pointer_cast<PathStats>(stats)) {
+            switch (request->type) {
+            case RequestType::SOURCE_RULE:
+                path_stats->source_stats_fields = request->stats;
+                break;
+            case RequestType::SINK_RULE:
+                path_stats->sink_stats_fields = request->stats;
+                break;
+            default:
+                assert(0);
+            }
+        }
+        else {
             assert(0);
         }
     }
-    else {
-        assert(0);
-    }
 }
 
 void StatsBucket::pass_port_request(PortRequestPtr request)
 {
-    auto stats = get_stats(request->id);
-    if (auto link_stats = std::dynamic_pointer_cast<LinkStats>(stats)) {
-        switch (request->type) {
-        case RequestType::SRC_PORT:
-            link_stats->src_stats_fields = request->stats;
-            break;
-        case RequestType::DST_PORT:
-            link_stats->dst_stats_fields = request->stats;
-            break;
-        default:
+    for (const auto& stats : pop_stats(request->id)) {
+        if (auto link_stats = std::dynamic_pointer_cast<LinkStats>(stats)) {
+            switch (request->type) {
+            case RequestType::SRC_PORT:
+                link_stats->src_stats_fields = request->stats;
+                break;
+            case RequestType::DST_PORT:
+                link_stats->dst_stats_fields = request->stats;
+                break;
+            default:
+                assert(0);
+            }
+        }
+        else {
             assert(0);
         }
     }
-    else {
-        assert(0);
-    }
 }
 
-StatsManager::StatsManager(std::shared_ptr<RequestIdGenerator> xid_generator):
-    xid_generator_(xid_generator)
+StatsManager::StatsManager(std::shared_ptr<RequestIdGenerator> xid_generator,
+                           size_t max_outstanding_buckets,
+                           size_t max_bucket_size):
+    xid_generator_(xid_generator),
+    max_outstanding_buckets_(max_outstanding_buckets),
+    max_bucket_size_(max_bucket_size)
 {
     add_front_bucket();
 }
@@ -139,6 +173,18 @@ Timestamp StatsManager::backTime() const
     return timestamp_deque_.back();
 }
 
+bool StatsManager::requestsExist() const
+{
+    return stats_timeline_.at(frontTime().id)->queriesExist();
+}
+
+bool StatsManager::requestsReady() const
+{
+    auto bucket = stats_timeline_.at(frontTime().id);
+    return bucket->size() >= max_bucket_size_ &&
+           outstandingBuckets() < max_outstanding_buckets_;
+}
+
 void StatsManager::requestRule(RulePtr rule)
 {
     auto time = frontTime();
@@ -177,22 +223,28 @@ void StatsManager::requestLink(PortPtr src_port, PortPtr dst_port)
     bucket->addStats(stats);
 }
 
-RequestList StatsManager::getNewRequests()
+RequestList StatsManager::getNewRequests(bool network_changed)
 {
     auto bucket = get_bucket(Position::FRONT);
     if (bucket->queriesExist()) {
+        // Requests wait for replies to previous buckets while the network
+        // is quiet, and are coalesced with the following ones
+        if (outstandingBuckets() >= max_outstanding_buckets_ &&
+                not network_changed) {
+            return RequestList();
+        }
         current_path_stats_.clear();
         auto requests = bucket->getRequests();
         add_front_bucket();
         return std::move(requests);
     }
-    else {
+    else if (network_changed) {
         // Delete empty bucket and increase front time
         //delete_back_bucket();
         delete_bucket(Position::FRONT);
         add_front_bucket();
-        return RequestList();
     }
+    return RequestList();
 }
 
 void StatsManager::passRequest(RequestPtr request)
@@ -204,9 +256,10 @@ void StatsManager::passRequest(RequestPtr request)
 StatsList StatsManager::popStatsList()
 {
     // Get queries
+    // The front bucket has not been sent yet
     auto timestamp = backTime().id;
     auto bucket = get_bucket(Position::BACK);
-    if (bucket->isFull()) {
+    if (outstandingBuckets() > 0u && bucket->isFull()) {
         auto queries = bucket->popStatsList();
         //delete_back_bucket();
         delete_bucket(Position::BACK);
@@ -10,6 +10,7 @@
 #include <memory>
 #include <set>
 #include <unordered_map>
+#include <vector>
 
 struct Stats
 {
@@ -77,15 +78,21 @@ using RuleRequestPtr = std::shared_ptr<RuleRequest>;
 struct RuleRequest : public Request
 {
     RuleRequest(RequestId id, RequestType type, Timestamp time,
-                RuleInfoPtr rule):
-        Request(id, time, type), rule(rule)
+                RuleInfoPtr rule, Cookie cookie_mask = EXACT_COOKIE_MASK):
+        Request(id, time, type), rule(rule), cookie_mask(cookie_mask)
     {
         assert(type == RequestType::RULE ||
                type == RequestType::SOURCE_RULE ||
                type == RequestType::SINK_RULE);
     };
 
+    virtual void addStats(Cookie, RuleStatsFields rule_stats) {
+        stats = rule_stats;
+    }
+
     RuleInfoPtr rule;
+    // Rules are selected by the cookie of the rule under this mask
+    Cookie cookie_mask;
     RuleStatsFields stats;
 
     static RuleRequestPtr pointerCast(RequestPtr request) {
@@ -93,6 +100,32 @@ struct RuleRequest : public Request
     }
 };
 
+struct InterceptorRequest;
+using InterceptorRequestPtr = std::shared_ptr<InterceptorRequest>;
+// Queries all interceptors of a switch in one round trip, the reply is
+// split between them by cookie
+struct InterceptorRequest : public RuleRequest
+{
+    InterceptorRequest(RequestId id, Timestamp time, SwitchId switch_id):
+        RuleRequest(id, RequestType::SOURCE_RULE, time,
+                    std::make_shared<RuleInfo>(
+                        switch_id, (TableId)0, ZERO_PRIORITY,
+                        INTERCEPTOR_COOKIE, Match::wholeSpace(),
+                        ActionsBase()),
+                    INTERCEPTOR_COOKIE_MASK) {}
+
+    void addStats(Cookie cookie, RuleStatsFields rule_stats) override {
+        interceptor_stats[cookie] = rule_stats;
+    }
+
+    std::vector<RuleInfoPtr> interceptors;
+    std::unordered_map<Cookie, RuleStatsFields> interceptor_stats;
+
+    static InterceptorRequestPtr pointerCast(RequestPtr request) {
+        return std::dynamic_pointer_cast<InterceptorRequest>(request);
+    }
+};
+
 struct PortRequest;
 using PortRequestPtr = std::shared_ptr<PortRequest>;
 struct PortRequest : public Request
@@ -178,14 +211,17 @@ public:
     std::list<StatsPtr> popStatsList() {return std::move(stats_list_);}
     bool isFull() const {return expected_requests_.empty();}
     bool queriesExist() const {return not stats_list_.empty();}
+    size_t size() const {return stats_list_.size();}
 
 private:
     std::list<StatsPtr> stats_list_;
-    // These requests have been sent to the network
-    std::map<RequestId, StatsPtr> expected_requests_;
+    // These requests have been sent to the network, an interceptor request
+    // serves all path stats of its switch
+    std::map<RequestId, std::vector<StatsPtr>> expected_requests_;
     std::shared_ptr<RequestIdGenerator> xid_generator_;
 
-    StatsPtr get_stats(RequestId id);
+    std::vector<StatsPtr> pop_stats(RequestId id);
+    void pass_interceptor_request(InterceptorRequestPtr request);
     void pass_rule_request(RuleRequestPtr request);
     void pass_port_request(PortRequestPtr request);
 };
@@ -201,17 +237,30 @@ class StatsManager
 {
     enum class Position {FRONT, BACK};
 public:
-    explicit StatsManager(std::shared_ptr<RequestIdGenerator> xid_generator);
+    static constexpr size_t MAX_OUTSTANDING_BUCKETS = 8;
+    static constexpr size_t MAX_BUCKET_SIZE = 512;
+
+    explicit StatsManager(
+        std::shared_ptr<RequestIdGenerator> xid_generator,
+        size_t max_outstanding_buckets = MAX_OUTSTANDING_BUCKETS,
+        size_t max_bucket_size = MAX_BUCKET_SIZE);
 
     Timestamp frontTime() const;
     Timestamp backTime() const;
+    size_t outstandingBuckets() const {return timestamp_deque_.size() - 1;}
+    bool requestsExist() const;
+    // The front bucket is large enough to be sent before the next tick
+    bool requestsReady() const;
 
     void requestRule(RulePtr rule);
     void requestPath(DomainPathPtr path);
     void requestLink(PortPtr src_port, PortPtr dst_port);
     void discardPathRequest(DomainPathPtr path);
 
-    RequestList getNewRequests();
+    // The front bucket stays open while the network is quiet, so quiet ticks
+    // share one timestamp. Buckets are not sent while too many of them wait
+    // for replies, unless the network has changed since the last tick.
+    RequestList getNewRequests(bool network_changed = true);
     void passRequest(RequestPtr request);
 
     StatsList popStatsList();
@@ -221,6 +270,8 @@ private:
     std::deque<Timestamp> timestamp_deque_;
     TimestampFactory timestamp_factory_;
     std::shared_ptr<RequestIdGenerator> xid_generator_;
+    size_t max_outstanding_buckets_;
+    size_t max_bucket_size_;
 
     // This map is used to quickly delete path stats that have not been sent
     // to the network.
@@ -1,9 +1,59 @@
 #include "HeaderSpace.hpp"
 
 #include <bitset>
+#include <cstring>
 
 int HeaderSpace::GLOBAL_LENGTH = 1;
 
+static size_t hash_combine(size_t seed, size_t value) {
+    return seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+}
+
+static size_t hash_array(const array_t* array, int length) {
+    size_t seed = 0;
+    for (size_t i = 0; i < (size_t)SIZE(length); i++) {
+        seed = hash_combine(seed, std::hash<array_t>{}(array[i]));
+    }
+    return seed;
+}
+
+static bool identical_arrays(const array_t* first, const array_t* second,
+                             int length) {
+    return 0 == memcmp(first, second, SIZE(length) * sizeof(array_t));
+}
+
+static size_t hash_vec(const struct hs_vec* vec, int length) {
+    size_t seed = (size_t)vec->used;
+    for (int i = 0; i < vec->used; i++) {
+        seed = hash_combine(seed, hash_array(vec->elems[i], length));
+        // Missing difference is the same as an empty one
+        if (vec->diff && vec->diff[i].used) {
+            seed = hash_combine(seed, hash_vec(&vec->diff[i], length));
+        }
+    }
+    return seed;
+}
+
+static bool identical_vecs(const struct hs_vec* first,
+                           const struct hs_vec* second, int length) {
+    if (first->used != second->used) {
+        return false;
+    }
+    for (int i = 0; i < first->used; i++) {
+        if (not identical_arrays(first->elems[i], second->elems[i], length)) {
+            return false;
+        }
+        // Missing difference is the same as an empty one
+        struct hs_vec empty_vec = {nullptr, nullptr, 0, 0};
+        auto first_diff = first->diff ? &first->diff[i] : &empty_vec;
+        auto second_diff = second->diff ? &second->diff[i] : &empty_vec;
+        if (not identical_vecs(first_diff, second_diff, length)) {
+            return false;
+        }
+    }
+    return true;
+}
+
 static int get_len(const char* str) {
     auto commas = (bool)strchr(str, ',');
     int div = CHAR_BIT + commas;
@@ -369,6 +419,20 @@ std::list<BitSpace> HeaderSpace::getBitSpace() const
     return bit_space;
 }
 
+size_t HeaderSpace::hash() const
+{
+    return hs_ ? hash_vec(&hs_->list, length_) : 0;
+}
+
+bool HeaderSpace::isIdentical(const HeaderSpace& other) const
+{
+    if (nullptr == hs_ || nullptr == other.hs_) {
+        return hs_ == other.hs_;
+    }
+    return length_ == other.length_ &&
+           identical_vecs(&hs_->list, &other.hs_->list, length_);
+}
+
 std::string HeaderSpace::toString() const
 {
     // Check header corruption
@@ -642,6 +706,29 @@ HeaderSpace HeaderChanger::inverse(const HeaderSpace& header) const
     return std::move(new_header);
 }
 
+size_t HeaderChanger::hash() const
+{
+    size_t seed = hash_combine((size_t)length_, (size_t)identity_);
+    if (mask_ && rewrite_) {
+        seed = hash_combine(seed, hash_array(mask_, length_));
+        seed = hash_combine(seed, hash_array(rewrite_, length_));
+    }
+    return seed;
+}
+
+bool HeaderChanger::isIdentical(const HeaderChanger& other) const
+{
+    if (length_ != other.length_ || identity_ != other.identity_) {
+        return false;
+    }
+    if (nullptr == mask_ || nullptr == other.mask_ ||
+            nullptr == rewrite_ || nullptr == other.rewrite_) {
+        return mask_ == other.mask_ && rewrite_ == other.rewrite_;
+    }
+    return identical_arrays(mask_, other.mask_, length_) &&
+           identical_arrays(rewrite_, other.rewrite_, length_);
+}
+
 std::string HeaderChanger::toString() const
 {
     // Check header changer corruption
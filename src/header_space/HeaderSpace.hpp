@@ -115,6 +115,11 @@ public:
 
     std::list<BitSpace> getBitSpace() const;
 
+    // Structural hash and comparison, they are cheap but only detect
+    // header spaces that have the same internal representation
+    size_t hash() const;
+    bool isIdentical(const HeaderSpace& other) const;
+
     static int GLOBAL_LENGTH;
 
     std::string toString() const;
@@ -159,6 +164,9 @@ public:
     int length() const {return length_;}
     int identity() const {return identity_;}
 
+    size_t hash() const;
+    bool isIdentical(const HeaderChanger& other) const;
+
     std::string toString() const;
     friend std::ostream& operator<<(std::ostream& os,
                                     const HeaderChanger& transfer);
@@ -2,9 +2,11 @@
 
 #include <map>
 #include <memory>
+#include <vector>
 
-EdgeInstaller::EdgeInstaller(RuleGraph& graph):
-    rule_graph_(graph)
+EdgeInstaller::EdgeInstaller(RuleGraph& graph,
+                             std::shared_ptr<WorkStealingPool> pool):
+    rule_graph_(graph), pool_(std::move(pool))
 {
 
 }
@@ -20,27 +22,75 @@ EdgeDiff EdgeInstaller::popEdgeDiff()
 EdgePtr EdgeInstaller::addEdge(VertexPtr src, VertexPtr dst,
                                Transfer transfer, bool is_dependent)
 {
-    auto src_domain = src->rule->domain();
-    auto domain = transfer.apply(src_domain) & dst->domain;
+    auto domain = NetworkSpace::emptySpace();
+    if (not find_domain(src, dst, transfer, domain)) {
+        domain = compute_domain(src, dst, transfer);
+        memo_domain(src, dst, transfer, domain);
+    }
     if (not domain.empty()) {
-        auto edge = rule_graph_.addEdge(
-            src, dst, transfer, domain
-        );
-        if (not is_dependent)
-            diff_.new_edges.emplace_back(edge);
-        else
-            diff_.new_dependent_edges.emplace_back(edge);
-        return edge;
+        return install_edge(src, dst, std::move(transfer),
+                            std::move(domain), is_dependent);
     }
     else {
         return EdgePtr(nullptr);
     }
 }
 
+void EdgeInstaller::addEdges(std::vector<EdgeCandidate>&& candidates,
+                             bool is_dependent)
+{
+    std::vector<NetworkSpace> domains(candidates.size(),
+                                      NetworkSpace::emptySpace());
+    std::vector<size_t> missed;
+    for (size_t i = 0; i < candidates.size(); i++) {
+        const auto& candidate = candidates[i];
+        if (not find_domain(candidate.src, candidate.dst,
+                            candidate.transfer, domains[i])) {
+            missed.push_back(i);
+        }
+    }
+
+    // Edge domains do not depend on each other, so workers compute them
+    // concurrently and only read the graph
+    auto compute_domains = [&candidates, &domains, &missed]
+                           (size_t begin, size_t end) {
+        for (auto i = begin; i < end; i++) {
+            const auto& candidate = candidates[missed[i]];
+            domains[missed[i]] = compute_domain(
+                candidate.src, candidate.dst, candidate.transfer
+            );
+        }
+    };
+    parallelFor(pool_.get(), missed.size(), EDGE_GRAIN_SIZE, compute_domains);
+    for (auto i : missed) {
+        memo_domain(candidates[i].src, candidates[i].dst,
+                    candidates[i].transfer, domains[i]);
+    }
+
+    // Install edges in the candidate order so the diff is deterministic
+    for (size_t i = 0; i < candidates.size(); i++) {
+        if (not domains[i].empty()) {
+            auto& candidate = candidates[i];
+            install_edge(candidate.src, candidate.dst,
+                         std::move(candidate.transfer),
+                         std::move(domains[i]), is_dependent);
+        }
+    }
+}
+
 void EdgeInstaller::updateEdge(EdgePtr edge)
 {
-    auto src_domain = edge->src->rule->domain();
-    auto domain = edge->transfer.apply(src_domain) & edge->dst->domain;
+    // Neither the src rule domain nor the transfer change over time
+    if (edge->dst_version == edge->dst->domain_version) {
+        return;
+    }
+
+    auto domain = NetworkSpace::emptySpace();
+    if (not find_domain(edge->src, edge->dst, edge->transfer, domain)) {
+        domain = compute_domain(edge->src, edge->dst, edge->transfer);
+        memo_domain(edge->src, edge->dst, edge->transfer, domain);
+    }
+    edge->dst_version = edge->dst->domain_version;
     if (not domain.empty()) {
         edge->domain = domain;
         diff_.changed_edges.emplace_back(edge);
@@ -92,8 +142,61 @@ void EdgeInstaller::clearEmptyEdges()
     empty_edges_.clear();
 }
 
-DependencyGraph::DependencyGraph(std::shared_ptr<Network> network):
-    network_(std::move(network)), edge_installer_(rule_graph_)
+NetworkSpace EdgeInstaller::compute_domain(VertexPtr src, VertexPtr dst,
+                                           const Transfer& transfer)
+{
+    auto src_domain = src->rule->domain();
+    auto domain = transfer.apply(src_domain) & dst->domain;
+    return domain.empty() ? NetworkSpace::emptySpace() : domain;
+}
+
+bool EdgeInstaller::find_domain(VertexPtr src, VertexPtr dst,
+                                const Transfer& transfer,
+                                NetworkSpace& domain) const
+{
+    auto it = domain_memo_.find(
+        DomainKey(src->id, dst->domain_version, transfer.hash())
+    );
+    if (it != domain_memo_.end() && it->second.transfer.isIdentical(transfer)) {
+        domain = it->second.domain;
+        return true;
+    }
+    return false;
+}
+
+void EdgeInstaller::memo_domain(VertexPtr src, VertexPtr dst,
+                                const Transfer& transfer,
+                                const NetworkSpace& domain)
+{
+    // Transfers with colliding hashes keep the first memoized domain
+    auto key = DomainKey(src->id, dst->domain_version, transfer.hash());
+    if (domain_memo_.emplace(key, MemoEntry{transfer, domain}).second) {
+        memo_order_.push_back(key);
+        if (memo_order_.size() > DOMAIN_MEMO_SIZE) {
+            domain_memo_.erase(memo_order_.front());
+            memo_order_.pop_front();
+        }
+    }
+}
+
+EdgePtr EdgeInstaller::install_edge(VertexPtr src, VertexPtr dst,
+                                    Transfer transfer, NetworkSpace&& domain,
+                                    bool is_dependent)
+{
+    auto edge = rule_graph_.addEdge(
+        src, dst, std::move(transfer), std::move(domain), dst->domain_version
+    );
+    if (not is_dependent)
+        diff_.new_edges.emplace_back(edge);
+    else
+        diff_.new_dependent_edges.emplace_back(edge);
+    return edge;
+}
+
+DependencyGraph::DependencyGraph(std::shared_ptr<Network> network,
+                                 std::shared_ptr<WorkStealingPool> pool):
+    network_(std::move(network)), pool_(pool), next_domain_version_(0),
+    edge_installer_(rule_graph_, std::move(pool))
 {
     
 }
@@ -106,6 +209,71 @@ void DependencyGraph::addRule(RulePtr rule)
     latest_diff_ += edge_installer_.popEdgeDiff();
 }
 
+void DependencyGraph::addRules(const std::vector<RulePtr>& rules)
+{
+    // Rules are expected to be in the network already, so the ones that are
+    // not processed yet are skipped until their own turn comes
+    for (const auto& rule : rules) {
+        if (RuleType::FLOW == rule->type()) {
+            precomputed_influences_[rule->sw()].rules.push_back(rule);
+        }
+    }
+
+    std::vector<SwitchInfluences*> switches;
+    for (auto& influences_pair : precomputed_influences_) {
+        switches.push_back(&influences_pair.second);
+    }
+    auto precompute = [this, &switches](size_t begin, size_t end) {
+        for (auto i = begin; i < end; i++) {
+            precompute_influences(*switches[i]);
+        }
+    };
+    parallelFor(pool_.get(), switches.size(), 1, precompute);
+
+    // Link edges cross the switches, so the rule graph is updated sequentially
+    for (const auto& rule : rules) {
+        addRule(rule);
+    }
+    precomputed_influences_.clear();
+}
+
+void DependencyGraph::precompute_influences(SwitchInfluences& influences)
+{
+    for (const auto& rule : influences.rules) {
+        auto table = rule->table();
+        if (table->isFrontTable() && rule->isTableMiss()) {
+            continue;
+        }
+
+        for (const auto& upper_rule : table->upperRules(rule)) {
+            auto domain = upper_rule->domain() & rule->domain();
+            if (domain.empty()) domain = NetworkSpace::emptySpace();
+            influences.domains.emplace(std::make_pair(upper_rule, rule),
+                                       std::move(domain));
+        }
+        for (const auto& lower_rule : table->lowerRules(rule)) {
+            auto domain = rule->domain() & lower_rule->domain();
+            if (domain.empty()) domain = NetworkSpace::emptySpace();
+            influences.domains.emplace(std::make_pair(rule, lower_rule),
+                                       std::move(domain));
+        }
+    }
+}
+
+NetworkSpace DependencyGraph::influence_domain(RulePtr upper_rule,
+                                               RulePtr lower_rule)
+{
+    auto switch_it = precomputed_influences_.find(upper_rule->sw());
+    if (switch_it != precomputed_influences_.end()) {
+        auto& domains = switch_it->second.domains;
+        auto it = domains.find(std::make_pair(upper_rule, lower_rule));
+        if (it != domains.end()) {
+            return it->second;
+        }
+    }
+    return upper_rule->domain() & lower_rule->domain();
+}
+
 void DependencyGraph::deleteRule(RulePtr rule)
 {
     assert(VertexPtr(nullptr) != rule->vertex_);
@@ -127,16 +295,22 @@ void DependencyGraph::addLink(Link link)
         edge_installer_.deleteOutEdges(dst_port->sourceRule()->vertex_);
 
         // Add edges that go through the link
+        std::vector<EdgeInstaller::EdgeCandidate> candidates;
         for (const auto& src_rule : src_port->srcRules()) {
             // Find port action that sends packets to the src rule
             auto action = src_rule->actions().getPortAction(src_port->id());
             assert(nullptr != action);
 
             // Transfer to the destination port
-            auto transfer = std::move(action->transfer);
+            auto transfer = action->transfer;
             transfer.dstPort(dst_port->id());
-            add_edges(src_rule, dst_port->dstRules(), std::move(transfer));
+            for (const auto& dst_rule : dst_port->dstRules()) {
+                if (not in_graph(dst_rule)) continue;
+                candidates.emplace_back(src_rule->vertex_, dst_rule->vertex_,
+                                        transfer);
+            }
         }
+        edge_installer_.addEdges(std::move(candidates));
     }
 
     latest_diff_ += edge_installer_.popEdgeDiff();
@@ -149,9 +323,9 @@ void DependencyGraph::deleteLink(Link link)
         auto& dst_port = directed_link.dst_port;
 
         // Move edges to source/sink rules
-        for (auto src_rule : src_port->srcRules()) {
+        for (const auto& src_rule : src_port->srcRules()) {
             // Delete edges between ports
-            for (auto dst_rule : dst_port->dstRules()) {
+            for (const auto& dst_rule : dst_port->dstRules()) {
                 edge_installer_.deleteEdge(src_rule->vertex_,
                                            dst_rule->vertex_);
             }
@@ -161,9 +335,11 @@ void DependencyGraph::deleteLink(Link link)
             assert(nullptr != action);
 
             // Add edges to the sink rule
+            auto transfer = action->transfer;
+            transfer.dstPort(src_port->id());
             edge_installer_.addEdge(src_rule->vertex_,
                                     src_port->sinkRule()->vertex_,
-                                    action->transfer);
+                                    std::move(transfer));
         }
 
         // Add edges from the source rule
@@ -173,6 +349,42 @@ void DependencyGraph::deleteLink(Link link)
     latest_diff_ += edge_installer_.popEdgeDiff();
 }
 
+void DependencyGraph::addGroup(GroupPtr group)
+{
+    auto group_rule = group->groupRule();
+    add_vertex(group_rule);
+
+    // Every bucket is shared by all rules that send packets to the group
+    std::vector<EdgeInstaller::EdgeCandidate> candidates;
+    for (const auto& bucket : group->buckets()) {
+        add_vertex(bucket);
+        add_out_edges(bucket);
+        candidates.emplace_back(group_rule->vertex_, bucket->vertex_,
+                                Transfer::identityTransfer());
+    }
+    edge_installer_.addEdges(std::move(candidates));
+
+    // Connect rules that were added before the group
+    for (const auto& src_rule : group->srcRules()) {
+        if (not in_graph(src_rule)) continue;
+        for (const auto& action : src_rule->actions().group_actions) {
+            if (action.group == group) {
+                add_edges_to_group(src_rule, action);
+            }
+        }
+    }
+
+    latest_diff_ += edge_installer_.popEdgeDiff();
+}
+
+void DependencyGraph::deleteGroup(GroupPtr group)
+{
+    for (const auto& bucket : group->buckets()) {
+        if (in_graph(bucket)) deleteRule(bucket);
+    }
+    if (in_graph(group->groupRule())) deleteRule(group->groupRule());
+}
+
 EdgeDiff DependencyGraph::popEdgeDiff()
 {
     auto diff = std::move(latest_diff_);
@@ -193,7 +405,8 @@ const Edge& DependencyGraph::edge(EdgePtr edge) const
 VertexPtr DependencyGraph::add_vertex(RulePtr rule)
 {
     auto vertex_desc = rule_graph_.addVertex(
-        Vertex(rule, rule->domain(), influence_graph_.addVertex())
+        Vertex(rule, rule->domain(), influence_graph_.addVertex(),
+               next_domain_version_++)
     );
     rule->vertex_ = vertex_desc;
     return vertex_desc;
@@ -225,19 +438,21 @@ void DependencyGraph::add_in_edges(RulePtr dst_rule)
     // TODO: Check table-miss that is not in the front table
     else {
         // Create influence from upper rules
-        for (auto upper_rule : table->upperRules(dst_rule)) {
-            auto influence_domain = upper_rule->domain() & dst_rule->domain();
-            if (not influence_domain.empty()) {
-                add_influence(upper_rule, dst_rule, influence_domain);
+        for (const auto& upper_rule : table->upperRules(dst_rule)) {
+            if (not in_graph(upper_rule)) continue;
+            auto domain = influence_domain(upper_rule, dst_rule);
+            if (not domain.empty()) {
+                add_influence(upper_rule, dst_rule, domain);
             }
         }
         update_domain(dst_rule);
 
         // Move edges from lower rules to the dst rule
-        for (auto lower_rule : table->lowerRules(dst_rule)) {
-            auto influence_domain = dst_rule->domain() & lower_rule->domain();
-            if (not influence_domain.empty()) {
-                add_influence(dst_rule, lower_rule, influence_domain);
+        for (const auto& lower_rule : table->lowerRules(dst_rule)) {
+            if (not in_graph(lower_rule)) continue;
+            auto domain = influence_domain(dst_rule, lower_rule);
+            if (not domain.empty()) {
+                add_influence(dst_rule, lower_rule, domain);
                 update_domain(lower_rule);
 
                 for (auto in_edge : rule_graph_.inEdges(lower_rule->vertex_)) {
@@ -290,7 +505,8 @@ void DependencyGraph::delete_in_edges(RulePtr dst_rule)
 
 void DependencyGraph::add_out_edges(RulePtr src_rule)
 {
-    if (src_rule->type() == RuleType::FLOW) {
+    if (src_rule->type() == RuleType::FLOW ||
+            src_rule->type() == RuleType::BUCKET) {
         for (const auto &port_action : src_rule->actions().port_actions) {
             add_edges_to_port(src_rule, port_action);
         }
@@ -308,21 +524,13 @@ void DependencyGraph::add_edges_to_port(RulePtr src_rule,
 {
     auto transfer = action.transfer;
     switch (action.port_type) {
-    case PortType::NORMAL: {
-        auto src_port = action.port;
-        auto dst_port = network_->adjacentPort(src_port);
-        if (dst_port) {
-            // Transfer to the destination port
-            transfer.dstPort(dst_port->id());
-            add_edges(src_rule, dst_port->dstRules(), std::move(transfer));
-        }
-        else {
-            edge_installer_.addEdge(src_rule->vertex_,
-                                    src_port->sinkRule()->vertex_,
-                                    std::move(transfer));
+    case PortType::NORMAL:
+    case PortType::IN_PORT:
+    case PortType::ALL:
+        for (auto port : network_->outPorts(src_rule, action)) {
+            add_edges_to_output(src_rule, port, transfer);
         }
         break;
-    }
     case PortType::DROP:
         edge_installer_.addEdge(src_rule->vertex_,
                                 network_->dropRule()->vertex_,
@@ -333,12 +541,23 @@ void DependencyGraph::add_edges_to_port(RulePtr src_rule,
                                 network_->controllerRule()->vertex_,
                                 std::move(transfer));
         break;
-    case PortType::IN_PORT:
-    case PortType::ALL:
-        // In this case every port may be an output getPort
-        // TODO: do it later with multiple actions and transfers
-        // TODO: if new getPort is added, should we add new dependencies?
-        break;
+    }
+}
+
+void DependencyGraph::add_edges_to_output(RulePtr src_rule, PortPtr port,
+                                          Transfer transfer)
+{
+    auto dst_port = network_->adjacentPort(port);
+    if (dst_port) {
+        // Transfer to the destination port
+        transfer.dstPort(dst_port->id());
+        add_edges(src_rule, dst_port->dstRules(), std::move(transfer));
+    }
+    else {
+        transfer.dstPort(port->id());
+        edge_installer_.addEdge(src_rule->vertex_,
+                                port->sinkRule()->vertex_,
+                                std::move(transfer));
     }
 }
 
@@ -353,7 +572,12 @@ void DependencyGraph::add_edges_to_table(RulePtr src_rule,
 void DependencyGraph::add_edges_to_group(RulePtr src_rule,
                                          const GroupAction& action)
 {
-
+    // Groups that are not in the graph yet connect their rules on addition
+    auto group_rule = action.group->groupRule();
+    if (in_graph(group_rule)) {
+        edge_installer_.addEdge(src_rule->vertex_, group_rule->vertex_,
+                                action.transfer);
+    }
 }
 
 void DependencyGraph::delete_out_edges(RulePtr src_rule)
@@ -364,14 +588,18 @@ void DependencyGraph::delete_out_edges(RulePtr src_rule)
 void DependencyGraph::add_edges(RulePtr src_rule, RuleRange dst_rules,
                                 Transfer transfer)
 {
+    std::vector<EdgeInstaller::EdgeCandidate> candidates;
     for (const auto& dst_rule : dst_rules) {
-        edge_installer_.addEdge(src_rule->vertex_, dst_rule->vertex_, transfer);
+        if (not in_graph(dst_rule)) continue;
+        candidates.emplace_back(src_rule->vertex_, dst_rule->vertex_, transfer);
     }
+    edge_installer_.addEdges(std::move(candidates));
 }
 
 void DependencyGraph::update_domain(RulePtr rule)
 {
     rule->vertex_->domain = rule->domain();
+    rule->vertex_->domain_version = next_domain_version_++;
     for (auto influence : influence_graph_.inEdges(rule->vertex_->influence_vertex)) {
         rule->vertex_->domain -= influence->domain;
     }
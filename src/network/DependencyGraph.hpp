@@ -4,8 +4,14 @@
 #include "Rule.hpp"
 #include "Vertex.hpp"
 #include "EdgeDiff.hpp"
+#include "../ConcurrencyPrimitives.hpp"
 
+#include <deque>
+#include <map>
 #include <memory>
+#include <tuple>
+#include <utility>
+#include <vector>
 
 class EdgeInstaller {
     struct EdgeData {
@@ -16,12 +22,23 @@ class EdgeInstaller {
         bool is_dependent;
     };
 public:
-    explicit EdgeInstaller(RuleGraph& graph);
+    struct EdgeCandidate {
+        EdgeCandidate(VertexPtr src, VertexPtr dst, Transfer transfer):
+            src(src), dst(dst), transfer(std::move(transfer)) {}
+
+        VertexPtr src;
+        VertexPtr dst;
+        Transfer transfer;
+    };
+
+    EdgeInstaller(RuleGraph& graph, std::shared_ptr<WorkStealingPool> pool);
     EdgeDiff popEdgeDiff();
 
     EdgePtr addEdge(VertexPtr src, VertexPtr dst,
                     Transfer transfer = Transfer::identityTransfer(),
                     bool is_dependent = false);
+    void addEdges(std::vector<EdgeCandidate>&& candidates,
+                  bool is_dependent = false);
     void updateEdge(EdgePtr edge);
     void deleteEdge(VertexPtr src, VertexPtr dst, bool is_dependent = false);
     void deleteOutEdges(VertexPtr src, bool is_dependent = false);
@@ -31,21 +48,55 @@ public:
 
 private:
     RuleGraph& rule_graph_;
+    std::shared_ptr<WorkStealingPool> pool_;
     EdgeDiff diff_;
     std::vector<EdgePtr> empty_edges_;
+
+    // Recently computed edge domains keyed on the src vertex id, the dst
+    // domain version and the transfer hash. Rule domains never change, but
+    // parallel edges between two rules may have different transfers, so a
+    // hit also requires an identical transfer
+    using DomainKey = std::tuple<uint64_t, uint64_t, size_t>;
+    struct MemoEntry {
+        Transfer transfer;
+        NetworkSpace domain;
+    };
+    std::map<DomainKey, MemoEntry> domain_memo_;
+    std::deque<DomainKey> memo_order_;
+
+    // Candidates are split into chunks of this size between pool workers
+    static constexpr size_t EDGE_GRAIN_SIZE = 32;
+    static constexpr size_t DOMAIN_MEMO_SIZE = 4096;
+
+    static NetworkSpace compute_domain(VertexPtr src, VertexPtr dst,
+                                       const Transfer& transfer);
+    bool find_domain(VertexPtr src, VertexPtr dst, const Transfer& transfer,
+                     NetworkSpace& domain) const;
+    void memo_domain(VertexPtr src, VertexPtr dst, const Transfer& transfer,
+                     const NetworkSpace& domain);
+
+    EdgePtr install_edge(VertexPtr src, VertexPtr dst, Transfer transfer,
+                         NetworkSpace&& domain, bool is_dependent);
 };
 
 class DependencyGraph
 {
 public:
-    explicit DependencyGraph(std::shared_ptr<Network> network);
+    explicit DependencyGraph(std::shared_ptr<Network> network,
+                             std::shared_ptr<WorkStealingPool> pool = nullptr);
 
     void addRule(RulePtr rule);
+    // Same as adding the rules one by one, but the table influences of the
+    // batch are precomputed in parallel per switch
+    void addRules(const std::vector<RulePtr>& rules);
     void deleteRule(RulePtr rule);
 
     void addLink(Link link);
     void deleteLink(Link link);
 
+    void addGroup(GroupPtr group);
+    void deleteGroup(GroupPtr group);
+
     EdgeDiff popEdgeDiff();
 
     EdgeRange outEdges(RulePtr rule) {return rule_graph_.outEdges(rule->vertex_);}
@@ -57,13 +108,31 @@ public:
     size_t size() const {return rule_graph_.vertices().size();}
 
 private:
+    // Table influences never cross a switch, so the influence domains of a
+    // rule batch are precomputed per switch concurrently. The rule graph is
+    // still updated by one thread in the order of the rules
+    struct SwitchInfluences {
+        std::vector<RulePtr> rules;
+        std::map<std::pair<RulePtr, RulePtr>, NetworkSpace> domains;
+    };
+
     std::shared_ptr<Network> network_;
+    std::shared_ptr<WorkStealingPool> pool_;
     RuleGraph rule_graph_;
     InfluenceGraph influence_graph_;
+    std::map<SwitchPtr, SwitchInfluences> precomputed_influences_;
+    uint64_t next_domain_version_;
 
     EdgeInstaller edge_installer_;
     EdgeDiff latest_diff_;
 
+    bool in_graph(RulePtr rule) const {
+        return VertexPtr(nullptr) != rule->vertex_;
+    }
+
+    void precompute_influences(SwitchInfluences& influences);
+    NetworkSpace influence_domain(RulePtr upper_rule, RulePtr lower_rule);
+
     VertexPtr add_vertex(RulePtr rule);
     void delete_vertex(RulePtr rule);
 
@@ -72,6 +141,8 @@ private:
 
     void add_out_edges(RulePtr src_rule);
     void add_edges_to_port(RulePtr src_rule, const PortAction& action);
+    void add_edges_to_output(RulePtr src_rule, PortPtr port,
+                             Transfer transfer);
     void add_edges_to_table(RulePtr src_rule, const TableAction& action);
     void add_edges_to_group(RulePtr src_rule, const GroupAction& action);
     void delete_out_edges(RulePtr src_rule);
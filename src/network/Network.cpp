@@ -7,12 +7,12 @@
 Network::Network()
 {
     // Create special rules
-    drop_rule_ = std::make_shared<Rule>(
+    drop_rule_ = makeRule(
         RuleType::SINK, nullptr, nullptr,
         LOW_PRIORITY, ZERO_COOKIE,
         NetworkSpace::wholeSpace(),
         Actions::noActions());
-    controller_rule_ = std::make_shared<Rule>(
+    controller_rule_ = makeRule(
         RuleType::SINK, nullptr, nullptr,
         LOW_PRIORITY, ZERO_COOKIE,
         NetworkSpace::wholeSpace(),
@@ -104,14 +104,19 @@ std::vector<RulePtr> Network::rules()
             rule_list.push_back(port->sourceRule());
             rule_list.push_back(port->sinkRule());
         }
+        for (const auto& group : sw->groups()) {
+            rule_list.push_back(group->groupRule());
+            rule_list.insert(rule_list.end(), group->buckets().begin(),
+                             group->buckets().end());
+        }
     }
     return rule_list;
 }
 
 RulePtr Network::rule(RuleId id) const
 {
-    auto switch_id = std::get<0>(id);
-    auto table_id = std::get<1>(id);
+    auto switch_id = id.switchId();
+    auto table_id = id.tableId();
 
     SwitchPtr sw = getSwitch(switch_id);
     TablePtr table = sw ? sw->table(table_id) : nullptr;
@@ -145,7 +150,6 @@ RulePtr Network::addRule(SwitchId switch_id, TableId table_id,
     }
 
     // Create rule
-    // TODO: check group existence
     auto actions_pair = get_actions(sw, std::move(actions_base));
     bool success = actions_pair.first;
     if (not success) {
@@ -167,8 +171,8 @@ RulePtr Network::addRule(SwitchId switch_id, TableId table_id,
 
 void Network::deleteRule(RuleId id)
 {
-    auto switch_id = std::get<0>(id);
-    auto table_id = std::get<1>(id);
+    auto switch_id = id.switchId();
+    auto table_id = id.tableId();
 
     SwitchPtr sw = getSwitch(switch_id);
     TablePtr table = sw ? sw->table(table_id) : nullptr;
@@ -221,6 +225,97 @@ Network::matchingRules(SwitchId switch_id, TableId table_id, const Match& match)
     return rules;
 }
 
+GroupPtr Network::getGroup(SwitchId switch_id, GroupId group_id) const
+{
+    SwitchPtr sw = getSwitch(switch_id);
+    return sw ? sw->group(group_id) : nullptr;
+}
+
+GroupPtr Network::addGroup(GroupInfo&& info)
+{
+    SwitchPtr sw = getSwitch(info.switch_id);
+    if (not sw) {
+        auto msg = "Wrong dpid:" + std::to_string(info.switch_id) +
+                   " for group:" + std::to_string(info.group_id);
+        throw std::invalid_argument(msg);
+    }
+    if (sw->group(info.group_id)) {
+        std::cerr << "Network error: Group already exists" << std::endl;
+        return nullptr;
+    }
+
+    auto group = sw->addGroup(info.group_id, info.type);
+    if (not set_buckets(group, std::move(info))) {
+        sw->deleteGroup(group->id());
+        return nullptr;
+    }
+    return group;
+}
+
+GroupPtr Network::modifyGroup(GroupInfo&& info)
+{
+    auto group = getGroup(info.switch_id, info.group_id);
+    if (group && set_buckets(group, std::move(info))) {
+        return group;
+    }
+    return nullptr;
+}
+
+void Network::deleteGroup(SwitchId switch_id, GroupId group_id)
+{
+    auto group = getGroup(switch_id, group_id);
+    if (group) {
+        // Rules that use the group are deleted with it
+        std::vector<RuleId> src_rules;
+        for (const auto& rule : group->srcRules()) {
+            src_rules.push_back(rule->id());
+        }
+        for (const auto& rule_id : src_rules) {
+            deleteRule(rule_id);
+        }
+
+        for (const auto& bucket : group->buckets()) {
+            delete_rule_from_topology(bucket);
+        }
+        group->sw()->deleteGroup(group_id);
+    }
+}
+
+std::vector<PortPtr> Network::outPorts(RulePtr rule,
+                                       const PortAction& action) const
+{
+    std::vector<PortPtr> ports;
+    auto sw = rule->sw();
+    auto in_port = sw->port(rule->inPort());
+    switch (action.port_type) {
+    case PortType::NORMAL:
+        ports.push_back(action.port);
+        break;
+    case PortType::ALL:
+        // Packets are not sent back to the input port
+        for (auto port : sw->ports()) {
+            if (port != in_port) {
+                ports.push_back(port);
+            }
+        }
+        break;
+    case PortType::IN_PORT:
+        // Rules that listen to all ports may send packets back to any port
+        if (in_port) {
+            ports.push_back(in_port);
+        }
+        else {
+            for (auto port : sw->ports()) {
+                ports.push_back(port);
+            }
+        }
+        break;
+    default:
+        break;
+    }
+    return ports;
+}
+
 PortPtr Network::adjacentPort(PortPtr port) const
 {
     auto it = topology_.find(port->topoId());
@@ -325,37 +420,65 @@ std::pair<bool, Actions> Network::get_actions(SwitchPtr sw,
             return std::make_pair(false, std::move(actions));
         }
     }
-    // TODO: implement group action parsing
-    // for (auto& group_action_base : actions_base.group_actions) {
-    //
-    // }
+    for (auto& group_action_base : actions_base.group_actions) {
+        auto group = sw->group(group_action_base.group_id);
+        if (group) {
+            GroupAction group_action(std::move(group_action_base), group);
+            actions.group_actions.emplace_back(std::move(group_action));
+        }
+        else {
+            return std::make_pair(false, std::move(actions));
+        }
+    }
     return std::make_pair(true, std::move(actions));
 }
 
+bool Network::set_buckets(GroupPtr group, GroupInfo&& info)
+{
+    std::vector<Actions> buckets;
+    for (auto& bucket_base : info.buckets) {
+        if (not bucket_base.group_actions.empty()) {
+            std::cerr << "Network error: Group chaining is not supported"
+                      << std::endl;
+            return false;
+        }
+        auto actions_pair = get_actions(group->sw(), std::move(bucket_base));
+        bool success = actions_pair.first;
+        auto& actions = actions_pair.second;
+        if (not success || not actions.table_actions.empty()) {
+            std::cerr << "Network error: Wrong bucket actions" << std::endl;
+            return false;
+        }
+        buckets.push_back(std::move(actions));
+    }
+
+    for (const auto& bucket : group->buckets()) {
+        delete_rule_from_topology(bucket);
+    }
+    group->setBuckets(info.type, std::move(buckets));
+    for (const auto& bucket : group->buckets()) {
+        add_rule_to_topology(bucket);
+    }
+    return true;
+}
+
 void Network::add_rule_to_topology(RulePtr rule)
 {
     auto sw = rule->sw();
     auto table = rule->table();
 
-    // Update src rules for ports
+    // Update src rules for ports and groups
     for (const auto& port_action : rule->actions().port_actions) {
-        switch (port_action.port_type) {
-        case PortType::NORMAL:
-            port_action.port->addSrcRule(rule);
-            break;
-        case PortType::ALL:
-        case PortType::IN_PORT:
-            for (auto port : sw->ports()) {
-                port->addSrcRule(rule);
-            }
-            break;
-        default:
-            break;
+        for (auto port : outPorts(rule, port_action)) {
+            port->addSrcRule(rule);
         }
     }
+    for (const auto& group_action : rule->actions().group_actions) {
+        group_action.group->addSrcRule(rule);
+    }
 
     // Update dst rules for ports
-    if (table->isFrontTable()) {
+    if (table && table->isFrontTable()) {
         auto in_port = sw->port(rule->inPort());
         if (in_port) {
             // Rule listens to a one specified getPort
@@ -375,25 +498,18 @@ void Network::delete_rule_from_topology(RulePtr rule)
     auto sw = rule->sw();
     auto table = rule->table();
 
-    // Update src rules for ports
+    // Update src rules for ports and groups
     for (const auto& port_action : rule->actions().port_actions) {
-        switch (port_action.port_type) {
-        case PortType::NORMAL:
-            port_action.port->deleteSrcRule(rule);
-            break;
-        case PortType::ALL:
-        case PortType::IN_PORT:
-            for (auto port : sw->ports()) {
-                port->deleteSrcRule(rule);
-            }
-            break;
-        default:
-            break;
+        for (auto port : outPorts(rule, port_action)) {
+            port->deleteSrcRule(rule);
         }
     }
+    for (const auto& group_action : rule->actions().group_actions) {
+        group_action.group->deleteSrcRule(rule);
+    }
 
     // Update dst rules for ports
-    if (table->isFrontTable()) {
+    if (table && table->isFrontTable()) {
         auto in_port = sw->port(rule->inPort());
         if (in_port) {
             // Rule listens to a one specified getPort
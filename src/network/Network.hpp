@@ -42,6 +42,15 @@ public:
 
     std::list<RulePtr> matchingRules(SwitchId switch_id, TableId table_id,
                                      const Match& match);
+
+    // Group management
+    GroupPtr getGroup(SwitchId switch_id, GroupId group_id) const;
+    GroupPtr addGroup(GroupInfo&& info);
+    GroupPtr modifyGroup(GroupInfo&& info);
+    void deleteGroup(SwitchId switch_id, GroupId group_id);
+
+    // Ports to which the port action of the rule may send packets
+    std::vector<PortPtr> outPorts(RulePtr rule, const PortAction& action) const;
     PortPtr adjacentPort(PortPtr port) const;
     std::pair<Link, bool> link(TopoId src_topo_id, TopoId dst_topo_id);
     std::pair<Link, bool> addLink(TopoId src_topo_id, TopoId dst_topo_id);
@@ -66,6 +75,7 @@ private:
 
     std::pair<bool, Actions> get_actions(SwitchPtr sw,
                                          ActionsBase&& actions_base) const;
+    bool set_buckets(GroupPtr group, GroupInfo&& info);
     void add_rule_to_topology(RulePtr rule);
     void delete_rule_from_topology(RulePtr rule);
 
@@ -15,12 +15,39 @@ std::shared_ptr<PortAction> Actions::getPortAction(PortId port_id) const
                   port_action.port->id() == port_id;
         }
     );
+    if (port_actions.end() == it) {
+        // Flooding actions may send packets to any port
+        it = std::find_if(port_actions.begin(), port_actions.end(),
+            [](const PortAction& port_action) -> bool {
+               return port_action.port_type == PortType::ALL ||
+                      port_action.port_type == PortType::IN_PORT;
+            }
+        );
+    }
     return port_actions.end() != it ? std::make_shared<PortAction>(*it)
                                     : nullptr;
 }
 
 IdGenerator<uint64_t> Rule::id_generator_;
 
+RuleSlab RuleSlab::instance_;
+
+RuleSlab::~RuleSlab()
+{
+    for (uint32_t index = 1u; index < next_index_; index++) {
+        if (slot(index).ref_count > 0u) {
+            get(index)->~Rule();
+        }
+    }
+}
+
+void RuleSlab::destroy(uint32_t index)
+{
+    get(index)->~Rule();
+    free_indices_.push_back(index);
+    size_--;
+}
+
 Rule::Rule(RuleType type, SwitchPtr sw, TablePtr table, Priority priority,
            Cookie cookie, Match&& match, Actions&& actions):
     type_(type), table_(table), sw_(sw), priority_(priority), cookie_(cookie),
@@ -57,7 +84,7 @@ Rule::Rule(const RulePtr other, Cookie cookie, const NetworkSpace& domain):
 
 Rule::~Rule()
 {
-    auto rule_num = std::get<3>(id_);
+    auto rule_num = id_.seq();
     id_generator_.releaseId(rule_num);
 }
 
@@ -97,7 +124,7 @@ bool Rule::isTableMiss() const
 
 size_t Rule::hash() const
 {
-    return std::hash<uint64_t>{}(std::get<3>(id_));
+    return std::hash<uint64_t>{}(id_.seq());
 }
 
 std::string Rule::toString() const
@@ -115,7 +142,7 @@ std::string Rule::toString() const
 
     std::ostringstream os;
     os << "[" << type
-       << ": id=" << std::get<3>(id_)
+       << ": id=" << id_.seq()
        << ": sw=" << sw
        << ", table=" << table
        << ", prio=" << std::to_string(priority_)
@@ -127,7 +154,7 @@ std::string Rule::toString() const
 
 bool Rule::operator==(const Rule& other) const
 {
-    if (not std::get<3>(id_)) {
+    if (not id_.seq()) {
         return false;
     }
     else {
@@ -162,7 +189,7 @@ RuleInfo::RuleInfo(SwitchId switch_id, TableId table_id, Priority priority,
 
 bool RuleInfo::operator==(const RuleInfo& other) const
 {
-    if (not std::get<3>(rule_id_)) {
+    if (not rule_id_.seq()) {
         return false;
     }
     else {
@@ -6,12 +6,15 @@
 #include "../openflow/Action.hpp"
 #include "../NetworkSpace.hpp"
 
+#include <cassert>
 #include <iostream>
 #include <functional>
+#include <limits>
 #include <list>
 #include <map>
 #include <memory>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 struct PortAction : public PortActionBase
@@ -185,6 +188,96 @@ private:
     RuleMappingDescriptor rule_mapping_;
 };
 
+// Rules are allocated in fixed-size chunks and addressed by 32-bit slot
+// indices. Slots count the handles of their rules, and released slots are
+// reused by new rules before the slab grows again
+class RuleSlab
+{
+public:
+    RuleSlab(): next_index_(1u), size_(0u) {}
+    RuleSlab(const RuleSlab& other) = delete;
+    RuleSlab& operator=(const RuleSlab& other) = delete;
+    ~RuleSlab();
+
+    template<class... Args>
+    RulePtr create(Args&&... args) {
+        uint32_t index;
+        if (not free_indices_.empty()) {
+            index = free_indices_.back();
+            free_indices_.pop_back();
+        }
+        else {
+            assert(next_index_ != std::numeric_limits<uint32_t>::max());
+            if (next_index_ / CHUNK_SIZE == chunks_.size()) {
+                chunks_.emplace_back(new Slot[CHUNK_SIZE]);
+            }
+            index = next_index_++;
+        }
+        auto& slot = this->slot(index);
+        new (&slot.rule) Rule(std::forward<Args>(args)...);
+        slot.ref_count = 1u;
+        size_++;
+        return RulePtr(index);
+    }
+
+    Rule* get(uint32_t index) {
+        return reinterpret_cast<Rule*>(&slot(index).rule);
+    }
+    void acquire(uint32_t index) {slot(index).ref_count++;}
+    void release(uint32_t index) {
+        auto& slot = this->slot(index);
+        assert(slot.ref_count > 0u);
+        if (0u == --slot.ref_count) {
+            destroy(index);
+        }
+    }
+
+    size_t size() const {return size_;}
+
+    static RuleSlab& instance() {return instance_;}
+
+private:
+    static constexpr uint32_t CHUNK_SIZE = 1024;
+    struct Slot {
+        std::aligned_storage<sizeof(Rule), alignof(Rule)>::type rule;
+        uint32_t ref_count;
+    };
+
+    std::vector<std::unique_ptr<Slot[]>> chunks_;
+    std::vector<uint32_t> free_indices_;
+    uint32_t next_index_;
+    size_t size_;
+
+    // Handles are dereferenced without a network, so all rules share one slab
+    static RuleSlab instance_;
+
+    Slot& slot(uint32_t index) {
+        return chunks_[index / CHUNK_SIZE][index % CHUNK_SIZE];
+    }
+    void destroy(uint32_t index);
+};
+
+template<class... Args>
+RulePtr makeRule(Args&&... args)
+{
+    return RuleSlab::instance().create(std::forward<Args>(args)...);
+}
+
+inline RulePtr::RulePtr(const RulePtr& other): index_(other.index_)
+{
+    if (NULL_INDEX != index_) RuleSlab::instance().acquire(index_);
+}
+
+inline RulePtr::~RulePtr()
+{
+    if (NULL_INDEX != index_) RuleSlab::instance().release(index_);
+}
+
+inline Rule* RulePtr::get() const
+{
+    return NULL_INDEX != index_ ? RuleSlab::instance().get(index_) : nullptr;
+}
+
 struct RuleInfo
 {
     RuleInfo(SwitchId switch_id, TableId table_id, Priority priority,
@@ -204,6 +297,19 @@ private:
     RuleId rule_id_;
 };
 
+struct GroupInfo
+{
+    GroupInfo(SwitchId switch_id, GroupId group_id, GroupType type,
+              std::vector<ActionsBase> buckets):
+        switch_id(switch_id), group_id(group_id), type(type),
+        buckets(std::move(buckets)) {}
+
+    SwitchId switch_id;
+    GroupId group_id;
+    GroupType type;
+    std::vector<ActionsBase> buckets;
+};
+
 struct Dependency {
     explicit Dependency(const EdgePtr edge):
         src(edge->src->rule), dst(edge->dst->rule),
@@ -0,0 +1,126 @@
+#include "RuleOperations.hpp"
+
+#include <fluid/of13/openflow-13.h>
+
+#include <cassert>
+#include <limits>
+
+void RuleOperationBuffer::addRule(RuleInfo&& info)
+{
+    auto pending = find_operation(info);
+    if (pending) {
+        // The rule exists after the pending operation, so the addition
+        // does nothing
+        dropped_operations_++;
+        return;
+    }
+    add_operation(RuleOperationType::ADD, std::move(info));
+}
+
+void RuleOperationBuffer::changeRule(RuleInfo&& info)
+{
+    auto pending = find_operation(info);
+    if (pending) {
+        // Only the last version of the rule is applied
+        auto& operation = pending->operation;
+        if (RuleOperationType::ADD == operation.type) {
+            operation.type = RuleOperationType::ADD_OR_MODIFY;
+        }
+        operation.info = std::move(info);
+        dropped_operations_++;
+        return;
+    }
+    add_operation(RuleOperationType::MODIFY, std::move(info));
+}
+
+void RuleOperationBuffer::deleteRule(RuleInfo&& info)
+{
+    // Pending rules that the deletion removes are never applied, as in
+    // Table::matchingRules()
+    auto first = live_operations_.lower_bound(
+        RuleKey(info.switch_id, 0u, 0u));
+    auto last = live_operations_.upper_bound(
+        RuleKey(info.switch_id, std::numeric_limits<TableId>::max(),
+                std::numeric_limits<Priority>::max()));
+    for (auto it = first; it != last;) {
+        auto table_id = std::get<1>(it->first);
+        auto& positions = it->second;
+        if (fluid_msg::of13::OFPTT_ALL == info.table_id ||
+                table_id == info.table_id) {
+            for (auto position = positions.begin();
+                 position != positions.end();) {
+                auto& pending = operation(*position);
+                if (pending.operation.info.match >= info.match) {
+                    drop_operation(pending);
+                    position = positions.erase(position);
+                }
+                else {
+                    position++;
+                }
+            }
+        }
+        it = positions.empty() ? live_operations_.erase(it) : std::next(it);
+    }
+
+    operations_.push_back({{RuleOperationType::DELETE, std::move(info)},
+                           false});
+}
+
+uint64_t RuleOperationBuffer::cut()
+{
+    live_operations_.clear();
+    last_cut_ = end_sequence();
+    return last_cut_;
+}
+
+std::vector<RuleOperation> RuleOperationBuffer::popOperations()
+{
+    live_operations_.clear();
+    return popOperations(end_sequence());
+}
+
+std::vector<RuleOperation> RuleOperationBuffer::popOperations(uint64_t bound)
+{
+    // Operations after the last cut may still be merged, so the bound must
+    // not split them
+    assert(live_operations_.empty() || bound <= last_cut_);
+    std::vector<RuleOperation> operations;
+    while (not operations_.empty() && first_sequence_ < bound) {
+        auto& pending = operations_.front();
+        if (not pending.is_dropped) {
+            operations.push_back(std::move(pending.operation));
+        }
+        operations_.pop_front();
+        first_sequence_++;
+    }
+    return operations;
+}
+
+RuleOperationBuffer::PendingOperation*
+RuleOperationBuffer::find_operation(const RuleInfo& info)
+{
+    auto it = live_operations_.find(rule_key(info));
+    if (it != live_operations_.end()) {
+        for (auto position : it->second) {
+            auto& pending = operation(position);
+            if (pending.operation.info.match == info.match) {
+                return &pending;
+            }
+        }
+    }
+    return nullptr;
+}
+
+void RuleOperationBuffer::add_operation(RuleOperationType type,
+                                        RuleInfo&& info)
+{
+    auto key = rule_key(info);
+    live_operations_[key].push_back(end_sequence());
+    operations_.push_back({{type, std::move(info)}, false});
+}
+
+void RuleOperationBuffer::drop_operation(PendingOperation& pending)
+{
+    pending.is_dropped = true;
+    dropped_operations_++;
+}
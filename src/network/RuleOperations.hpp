@@ -0,0 +1,84 @@
+#pragma once
+
+#include "Rule.hpp"
+#include "../Types.hpp"
+
+#include <deque>
+#include <map>
+#include <tuple>
+#include <vector>
+
+enum class RuleOperationType
+{
+    ADD,
+    MODIFY,
+    // Result of an addition followed by modifications
+    ADD_OR_MODIFY,
+    DELETE
+};
+
+struct RuleOperation
+{
+    RuleOperationType type;
+    RuleInfo info;
+};
+
+// Collects the rule updates of the controller before they reach the
+// network. Updates of one rule are merged into one operation, and the
+// updates that a later deletion removes are dropped. A cut splits the
+// updates, so the ones before it are applied without the later ones.
+class RuleOperationBuffer
+{
+public:
+    RuleOperationBuffer():
+        first_sequence_(0u), last_cut_(0u), dropped_operations_(0u) {}
+
+    void addRule(RuleInfo&& info);
+    void changeRule(RuleInfo&& info);
+    void deleteRule(RuleInfo&& info);
+
+    bool empty() const {return operations_.empty();}
+    // Number of operations that merging made unnecessary
+    size_t droppedOperations() const {return dropped_operations_;}
+
+    // Later updates are not merged into the earlier ones, returns the bound
+    // of the earlier updates for popOperations()
+    uint64_t cut();
+
+    // Returns the remaining operations in the order of their arrival
+    std::vector<RuleOperation> popOperations();
+    // Returns the remaining operations before the cut with the given bound
+    std::vector<RuleOperation> popOperations(uint64_t bound);
+
+private:
+    using RuleKey = std::tuple<SwitchId, TableId, Priority>;
+
+    struct PendingOperation {
+        RuleOperation operation;
+        bool is_dropped;
+    };
+
+    std::deque<PendingOperation> operations_;
+    // Sequence number of the first pending operation
+    uint64_t first_sequence_;
+    uint64_t last_cut_;
+    // Sequence numbers of the pending additions and modifications by rule
+    // since the last cut
+    std::map<RuleKey, std::vector<uint64_t>> live_operations_;
+    size_t dropped_operations_;
+
+    static RuleKey rule_key(const RuleInfo& info) {
+        return RuleKey(info.switch_id, info.table_id, info.priority);
+    }
+
+    uint64_t end_sequence() const {
+        return first_sequence_ + operations_.size();
+    }
+    PendingOperation& operation(uint64_t sequence) {
+        return operations_[sequence - first_sequence_];
+    }
+
+    PendingOperation* find_operation(const RuleInfo& info);
+    void add_operation(RuleOperationType type, RuleInfo&& info);
+    void drop_operation(PendingOperation& pending);
+};
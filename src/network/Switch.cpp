@@ -28,27 +28,22 @@ RulePtr Table::rule(RuleId id) const
 
 RulePtr Table::rule(Priority priority, const Match& match)
 {
-    RuleId id(sw_->id(), id_, priority, 0x0);
-    //auto upper_bound = rule_map_.upper_bound(id);
-    auto it = std::find_if(rule_map_.begin(), rule_map_.end(),//upper_bound,
-        [priority, match](const std::pair<RuleId, RulePtr>& rule_pair) -> bool {
-            auto lower_rule = rule_pair.second;
-            if (priority == lower_rule->priority()) {
-                return match == lower_rule->match();
-            }
-            else {
-                return false;
-            }
+    // Rules with the same priority are adjacent in the map
+    auto it = rule_map_.lower_bound(priority_bound(priority, RuleId::MAX_SEQ));
+    auto end = rule_map_.upper_bound(priority_bound(priority, 0));
+    for (; it != end; it++) {
+        if (match == it->second->match()) {
+            return it->second;
         }
-    );
-    return it != rule_map_.end() ? it->second : nullptr;
+    }
+    return nullptr;
 }
 
 RulePtr Table::addRule(Priority priority, Cookie cookie,
                        Match&& match, Actions&& actions)
 {
     // TODO: Check rule rewrite (and table-miss rewrite)
-    auto rule = std::make_shared<Rule>(
+    auto rule = makeRule(
         RuleType::FLOW, sw_, this, priority, cookie,
         std::move(match), std::move(actions));
     return rule_map_[rule->id()] = rule;
@@ -67,7 +62,7 @@ std::list<RulePtr> Table::matchingRules(const Match& match) const
 {
     std::list<RulePtr> rules;
     for (const auto& rule_it : rule_map_) {
-        auto rule = rule_it.second;
+        const auto& rule = rule_it.second;
         if (rule->match() >= match) {
             rules.push_back(rule);
         }
@@ -75,32 +70,26 @@ std::list<RulePtr> Table::matchingRules(const Match& match) const
     return rules;
 }
 
-RuleRange Table::upperRules(RulePtr rule)
+RuleRange Table::upperRules(const RulePtr& rule)
 {
-    auto it = rule_map_.upper_bound(rule->id());
-    RuleMap::reverse_iterator reverse_it(it);
-    auto upper_bound = std::find_if(reverse_it, rule_map_.rend(),
-        [rule](const std::pair<RuleId, RulePtr>& rule_pair) -> bool {
-            auto upper_rule = rule_pair.second;
-            return rule->priority() < upper_rule->priority();
-        }
-    );
-    return {rule_map_, rule_map_.begin(), upper_bound.base()};
+    // The map is sorted by descending priority
+    auto upper_bound = rule_map_.lower_bound(
+        priority_bound(rule->priority(), RuleId::MAX_SEQ));
+    return {rule_map_, rule_map_.begin(), upper_bound};
 }
 
-RuleRange Table::lowerRules(RulePtr rule)
+RuleRange Table::lowerRules(const RulePtr& rule)
 {
-    auto it = rule_map_.lower_bound(rule->id());
-    auto lower_bound = std::find_if(it, rule_map_.end(),
-        [rule](const std::pair<RuleId, RulePtr>& rule_pair) -> bool {
-            auto lower_rule = rule_pair.second;
-            return rule->priority() > lower_rule->priority();
-        }
-    );
-    // TODO: CRITICAL - check std::greater<> with upper/lower bounds
+    auto lower_bound = rule_map_.upper_bound(
+        priority_bound(rule->priority(), 0));
     return {rule_map_, lower_bound, rule_map_.end()};
 }
 
+RuleId Table::priority_bound(Priority priority, uint64_t seq) const
+{
+    return RuleId(sw_->id(), id_, priority, seq);
+}
+
 bool Table::isFrontTable() const
 {
     return sw_->frontTable()->id() == id_;
@@ -109,14 +98,14 @@ bool Table::isFrontTable() const
 Port::Port(SwitchPtr sw, PortInfo info):
     id_(info.id), speed_(info.speed), sw_(sw), switch_id_(sw->id())
 {
-    source_rule_ = std::make_shared<Rule>(
+    source_rule_ = makeRule(
         RuleType::SOURCE, sw_, nullptr,
         LOW_PRIORITY, ZERO_COOKIE,
         NetworkSpace(id_),
         Actions::noActions());
         //Actions::forwardAction(
         //    sw_->frontTable()->id(), sw_->frontTable()));
-    sink_rule_ = std::make_shared<Rule>(
+    sink_rule_ = makeRule(
         RuleType::SINK, sw_, nullptr,
         LOW_PRIORITY, ZERO_COOKIE,
         NetworkSpace(id_), Actions::noActions());
@@ -138,6 +127,55 @@ void Port::delete_rule(RulePtr rule, RuleMap& rule_map)
     rule_map.erase(rule->id());
 }
 
+Group::Group(SwitchPtr sw, GroupId id, GroupType type):
+    id_(id), sw_(sw), type_(type)
+{
+    group_rule_ = makeRule(
+        RuleType::GROUP, sw_, nullptr,
+        LOW_PRIORITY, ZERO_COOKIE,
+        NetworkSpace::wholeSpace(), Actions::noActions());
+}
+
+Group::~Group()
+{
+    buckets_.clear();
+    src_rules_.clear();
+}
+
+void Group::setBuckets(GroupType type, std::vector<Actions>&& buckets)
+{
+    // Packets take all buckets of ALL groups and a single bucket of other
+    // group types. Since the chosen bucket depends on the packet hash or
+    // port liveness, every bucket is considered reachable
+    type_ = type;
+    buckets_.clear();
+    for (auto& actions : buckets) {
+        // Flooding buckets never send packets back to their input port, so
+        // they are split into a rule per input port
+        bool depends_on_in_port = std::any_of(
+            actions.port_actions.begin(), actions.port_actions.end(),
+            [](const PortAction& action) {
+                return action.port_type == PortType::ALL ||
+                       action.port_type == PortType::IN_PORT;
+            });
+        if (depends_on_in_port) {
+            for (auto port : sw_->ports()) {
+                auto port_actions = actions;
+                buckets_.push_back(makeRule(
+                    RuleType::BUCKET, sw_, nullptr,
+                    LOW_PRIORITY, ZERO_COOKIE,
+                    NetworkSpace(port->id()), std::move(port_actions)));
+            }
+        }
+        else {
+            buckets_.push_back(makeRule(
+                RuleType::BUCKET, sw_, nullptr,
+                LOW_PRIORITY, ZERO_COOKIE,
+                NetworkSpace::wholeSpace(), std::move(actions)));
+        }
+    }
+}
+
 Switch::Switch(const SwitchInfo& info):
     id_(info.id), table_number_(info.table_number)
 {
@@ -165,6 +203,12 @@ Switch::~Switch()
         delete it.second;
     }
     table_map_.clear();
+
+    // Delete groups
+    for (auto it : group_map_) {
+        delete it.second;
+    }
+    group_map_.clear();
 }
 
 PortPtr Switch::port(PortId id) const
@@ -200,3 +244,25 @@ TablePtr Switch::addTable(TableId id)
         return nullptr;
     }
 }
+
+GroupPtr Switch::group(GroupId id) const
+{
+    auto it = group_map_.find(id);
+    return it != group_map_.end() ? it->second : nullptr;
+}
+
+GroupPtr Switch::addGroup(GroupId id, GroupType type)
+{
+    // Check existing group
+    GroupPtr old_group = group(id);
+    return old_group ? old_group : group_map_[id] = new Group(this, id, type);
+}
+
+void Switch::deleteGroup(GroupId id)
+{
+    auto it = group_map_.find(id);
+    if (it != group_map_.end()) {
+        delete it->second;
+        group_map_.erase(it);
+    }
+}
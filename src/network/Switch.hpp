@@ -24,8 +24,8 @@ public:
     std::list<RulePtr> matchingRules(const Match& match) const;
     RulePtr tableMissRule() const {return table_miss_rule_;}
     RuleRange rules() {return RuleRange(rule_map_);}
-    RuleRange upperRules(RulePtr rule);
-    RuleRange lowerRules(RulePtr rule);
+    RuleRange upperRules(const RulePtr& rule);
+    RuleRange lowerRules(const RulePtr& rule);
 
     bool isFrontTable() const;
 
@@ -36,6 +36,8 @@ private:
     RuleMap rule_map_;
     RulePtr table_miss_rule_;
 
+    RuleId priority_bound(Priority priority, uint64_t seq) const;
+
 };
 
 class Port
@@ -79,10 +81,44 @@ private:
     void delete_rule(RulePtr rule, RuleMap& rule_map);
 };
 
+class Group
+{
+public:
+    Group(SwitchPtr sw, GroupId id, GroupType type);
+    ~Group();
+
+    GroupId id() const {return id_;}
+    SwitchPtr sw() const {return sw_;}
+    GroupType type() const {return type_;}
+
+    // All rules that use the group share the group rule, which fans out
+    // packets to the bucket rules
+    RulePtr groupRule() const {return group_rule_;}
+    const std::vector<RulePtr>& buckets() const {return buckets_;}
+    void setBuckets(GroupType type, std::vector<Actions>&& buckets);
+
+    RulePtr addSrcRule(RulePtr rule) {return src_rules_[rule->id()] = rule;}
+    void deleteSrcRule(RulePtr rule) {src_rules_.erase(rule->id());}
+
+    // Rules that send packets to the group
+    RuleRange srcRules() {return RuleRange(src_rules_);}
+
+private:
+    GroupId id_;
+    SwitchPtr sw_;
+    GroupType type_;
+
+    RulePtr group_rule_;
+    std::vector<RulePtr> buckets_;
+    RuleMap src_rules_;
+
+};
+
 class Switch
 {
     using PortRange = MapRange<std::map<PortId, PortPtr>>;
     using TableRange = MapRange<std::map<TableId, TablePtr>>;
+    using GroupRange = MapRange<std::map<GroupId, GroupPtr>>;
 
 public:
     explicit Switch(const SwitchInfo& info);
@@ -91,11 +127,15 @@ public:
     SwitchId id() const {return id_;}
     uint8_t tableNumber() const {return table_number_;}
     TablePtr addTable(TableId id);
+    GroupPtr addGroup(GroupId id, GroupType type);
+    void deleteGroup(GroupId id);
 
     PortPtr port(PortId id) const;
     TablePtr table(TableId id) const;
+    GroupPtr group(GroupId id) const;
     PortRange ports() {return PortRange(port_map_);}
     TableRange tables() {return TableRange(table_map_);}
+    GroupRange groups() {return GroupRange(group_map_);}
     TablePtr frontTable() {return front_table_;}
 
 private:
@@ -103,6 +143,7 @@ private:
 
     std::map<PortId, PortPtr> port_map_;
     std::map<TableId, TablePtr> table_map_;
+    std::map<GroupId, GroupPtr> group_map_;
     TablePtr front_table_;
     uint8_t table_number_;
 
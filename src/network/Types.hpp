@@ -2,20 +2,80 @@
 
 #include "../Types.hpp"
 
+#include <cstddef>
+#include <cstdint>
 #include <map>
 #include <memory>
+#include <utility>
 
 class Switch;
 class Port;
 class Table;
-class Group {}; // TODO: implement groups
+class Group;
 class Rule;
 using SwitchPtr = Switch*;
 using PortPtr = Port*;
 using TablePtr = Table*;
 using GroupPtr = Group*;
-//using RulePtr = Rule*;
-using RulePtr = std::shared_ptr<Rule>;
+
+// Rules are stored in the rule slab and referred to by 32-bit handles. The
+// references are counted without atomics, so rules are created, copied and
+// released by one thread at a time, parallel readers only dereference them
+class RulePtr
+{
+public:
+    RulePtr(): index_(NULL_INDEX) {}
+    RulePtr(std::nullptr_t): index_(NULL_INDEX) {}
+    RulePtr(const RulePtr& other);
+    RulePtr(RulePtr&& other) noexcept: index_(other.index_) {
+        other.index_ = NULL_INDEX;
+    }
+    ~RulePtr();
+
+    RulePtr& operator=(RulePtr other) noexcept {
+        std::swap(index_, other.index_);
+        return *this;
+    }
+
+    Rule* get() const;
+    Rule& operator*() const {return *get();}
+    Rule* operator->() const {return get();}
+    explicit operator bool() const {return NULL_INDEX != index_;}
+
+    uint32_t index() const {return index_;}
+
+    bool operator==(const RulePtr& other) const {
+        return index_ == other.index_;
+    }
+    bool operator!=(const RulePtr& other) const {
+        return index_ != other.index_;
+    }
+    bool operator<(const RulePtr& other) const {
+        return index_ < other.index_;
+    }
+    friend bool operator==(const RulePtr& rule, std::nullptr_t) {
+        return NULL_INDEX == rule.index_;
+    }
+    friend bool operator==(std::nullptr_t, const RulePtr& rule) {
+        return NULL_INDEX == rule.index_;
+    }
+    friend bool operator!=(const RulePtr& rule, std::nullptr_t) {
+        return NULL_INDEX != rule.index_;
+    }
+    friend bool operator!=(std::nullptr_t, const RulePtr& rule) {
+        return NULL_INDEX != rule.index_;
+    }
+
+private:
+    static constexpr uint32_t NULL_INDEX = 0u;
+
+    // Takes over the reference of a new slab slot
+    explicit RulePtr(uint32_t index): index_(index) {}
+
+    uint32_t index_;
+
+    friend class RuleSlab;
+};
 
 struct PortInfo
 {
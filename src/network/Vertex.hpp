@@ -19,20 +19,30 @@ using InfluenceGraph = Graph<EmptyVertex, Influence>;
 using InfluenceVertex = InfluenceGraph::VertexPtr;
 
 struct Vertex {
-    Vertex(RulePtr rule, NetworkSpace domain, InfluenceVertex influence):
-        rule(rule), domain(domain), influence_vertex(influence) {}
+    Vertex(RulePtr rule, NetworkSpace domain, InfluenceVertex influence,
+           uint64_t version):
+        rule(rule), domain(domain), influence_vertex(influence),
+        id(version), domain_version(version) {}
 
     RulePtr rule;
     NetworkSpace domain;
     InfluenceVertex influence_vertex;
+
+    // Unique among all vertices ever created, unlike reused rule ids
+    uint64_t id;
+    // Changes with every domain update and is unique among all vertices
+    uint64_t domain_version;
 };
 
 struct Edge {
-    Edge(Transfer transfer, NetworkSpace domain):
-        transfer(transfer), domain(domain) {}
+    Edge(Transfer transfer, NetworkSpace domain, uint64_t dst_version):
+        transfer(transfer), domain(domain), dst_version(dst_version) {}
 
     Transfer transfer;
     NetworkSpace domain;
+
+    // Version of the dst vertex domain the edge domain is computed from
+    uint64_t dst_version;
 };
 
 using RuleGraph = Graph<Vertex, Edge>;
@@ -21,6 +21,14 @@ enum class PortType
     CONTROLLER
 };
 
+enum class GroupType
+{
+    ALL,
+    SELECT,
+    INDIRECT,
+    FAST_FAILOVER
+};
+
 struct Action
 {
     Action(const Action& other) = default;
@@ -8,137 +8,221 @@
 #include <fluid/of10/openflow-10.h>
 #include <fluid/of13/openflow-13.h>
 
+#include <arpa/inet.h>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
 #include <type_traits>
 
-template<class ReturnType, class BaseMessage>
-class MessageDispatcher
-{
-public:
-    template<class Message>
-    struct Visitor;
-
-    struct VisitorInterface {
-        template<class Message>
-        ReturnType visitMessage(Message& message) {
-            if (auto self = dynamic_cast<Visitor<Message>*>(this)) {
-                return self->visit(message);
-            }
-            else if (auto self = dynamic_cast<Visitor<BaseMessage>*>(this)) {
-                return self->visit(message);
-            }
-            else {
-                throw std::invalid_argument("Visitor error: Wrong visitor");
-            }
-        }
+template<class... Messages>
+struct MessageList {};
 
-        virtual ~VisitorInterface() = default;
-    };
+// Position of the message type in the list
+template<class Message, class List>
+struct MessageIndex;
 
-    // TODO: add Args...
-    template<class Message>
-    struct Visitor : public virtual VisitorInterface {
-        virtual ReturnType visit(Message& message) = 0;
-    };
+template<class Message, class... Others>
+struct MessageIndex<Message, MessageList<Message, Others...>>:
+    std::integral_constant<size_t, 0u> {};
 
-    struct DispatchableInterface {
-        virtual ReturnType accept(VisitorInterface& visitor) = 0;
-    };
+template<class Message, class Other, class... Others>
+struct MessageIndex<Message, MessageList<Other, Others...>>:
+    std::integral_constant<
+        size_t, 1u + MessageIndex<Message, MessageList<Others...>>::value
+    > {};
 
-    template<class Message>
-    struct DispatchableMessage : virtual Message, DispatchableInterface {
-        ReturnType accept(VisitorInterface& visitor) override {
-            return visitor.visitMessage((Message&)*this);
-        }
-    };
+// Messages known to the dispatchers, a message is identified in the dispatch
+// tables by its index in this list
+using OpenFlowMessages = MessageList<
+    // Symmetric messages
+    fluid_msg::of13::Hello,
+    fluid_msg::of13::Error,
+    fluid_msg::of13::EchoRequest,
+    fluid_msg::of13::EchoReply,
+    fluid_msg::of13::Experimenter,
 
-    ReturnType operator()(RawMessage raw_message, VisitorInterface& visitor) {
-        return dispatch_message(raw_message, visitor);
-    }
+    // Controller messages
+    fluid_msg::of13::FeaturesRequest,
+    fluid_msg::of13::GetConfigRequest,
+    fluid_msg::of13::SetConfig,
+    fluid_msg::of13::PacketOut,
+    fluid_msg::of13::FlowMod,
+    fluid_msg::of13::GroupMod,
+    fluid_msg::of13::PortMod,
+    fluid_msg::of13::TableMod,
+    fluid_msg::of13::MeterMod,
+    fluid_msg::of13::BarrierRequest,
+    fluid_msg::of13::QueueGetConfigRequest,
+    fluid_msg::of13::RoleRequest,
+    fluid_msg::of13::GetAsyncRequest,
+    fluid_msg::of13::SetAsync,
+    fluid_msg::of13::MultipartRequestDesc,
+    fluid_msg::of13::MultipartRequestFlow,
+    fluid_msg::of13::MultipartRequestAggregate,
+    fluid_msg::of13::MultipartRequestTable,
+    fluid_msg::of13::MultipartRequestPortStats,
+    fluid_msg::of13::MultipartRequestQueue,
+    fluid_msg::of13::MultipartRequestGroup,
+    fluid_msg::of13::MultipartRequestGroupDesc,
+    fluid_msg::of13::MultipartRequestGroupFeatures,
+    fluid_msg::of13::MultipartRequestMeter,
+    fluid_msg::of13::MultipartRequestMeterConfig,
+    fluid_msg::of13::MultipartRequestMeterFeatures,
+    fluid_msg::of13::MultipartRequestTableFeatures,
+    fluid_msg::of13::MultipartRequestPortDescription,
+    fluid_msg::of13::MultipartRequestExperimenter,
 
-private:
-    template<class Message>
-    ReturnType dispatch(RawMessage raw_message,
-                        VisitorInterface& visitor) const {
-        auto message = std::make_unique<DispatchableMessage<Message>>();
-        auto error = message->unpack(raw_message.data());
+    // Switch messages
+    fluid_msg::of13::FeaturesReply,
+    fluid_msg::of13::GetConfigReply,
+    fluid_msg::of13::PacketIn,
+    fluid_msg::of13::FlowRemoved,
+    fluid_msg::of13::PortStatus,
+    fluid_msg::of13::BarrierReply,
+    fluid_msg::of13::QueueGetConfigReply,
+    fluid_msg::of13::RoleReply,
+    fluid_msg::of13::GetAsyncReply,
+    fluid_msg::of13::MultipartReplyDesc,
+    fluid_msg::of13::MultipartReplyFlow,
+    fluid_msg::of13::MultipartReplyAggregate,
+    fluid_msg::of13::MultipartReplyTable,
+    fluid_msg::of13::MultipartReplyPortStats,
+    fluid_msg::of13::MultipartReplyQueue,
+    fluid_msg::of13::MultipartReplyGroup,
+    fluid_msg::of13::MultipartReplyGroupDesc,
+    fluid_msg::of13::MultipartReplyGroupFeatures,
+    fluid_msg::of13::MultipartReplyMeter,
+    fluid_msg::of13::MultipartReplyMeterConfig,
+    fluid_msg::of13::MultipartReplyMeterFeatures,
+    fluid_msg::of13::MultipartReplyTableFeatures,
+    fluid_msg::of13::MultipartReplyPortDescription,
+    fluid_msg::of13::MultipartReplyExperimenter
+>;
+
+// Message unpacked once, so all the dispatchers visit the same object. It is
+// packed again only if a visitor changed it and marked it dirty.
+class DecodedMessage
+{
+public:
+    explicit DecodedMessage(const RawMessage& raw_message):
+        index_(message_index(raw_message)),
+        message_(create_message(index_, OpenFlowMessages())),
+        is_dirty_(false)
+    {
+        auto error = message_->unpack(raw_message.data());
         if (error) {
             throw std::logic_error(
                 "Message unpack error: Error code " + std::to_string(error)
             );
         }
-        return message->accept(visitor);
     }
 
-    ReturnType dispatch_message(RawMessage raw_message,
-                                VisitorInterface& visitor) const {
+    template<class Message>
+    static constexpr size_t indexOf() {
+        return MessageIndex<Message, OpenFlowMessages>::value;
+    }
+
+    size_t index() const {return index_;}
+    fluid_msg::OFMsg& message() const {return *message_;}
+
+    bool dirty() const {return is_dirty_;}
+    void markDirty() {is_dirty_ = true;}
+    RawMessage encode() const {return RawMessage(*message_);}
+
+private:
+    static constexpr size_t HEADER_SIZE = 8u;
+    static constexpr size_t MULTIPART_HEADER_SIZE = 16u;
+    static constexpr size_t MULTIPART_TYPE_OFFSET = 8u;
+
+    size_t index_;
+    std::unique_ptr<fluid_msg::OFMsg> message_;
+    bool is_dirty_;
+
+    template<class Message>
+    static fluid_msg::OFMsg* create() {return new Message();}
+
+    template<class... Messages>
+    static std::unique_ptr<fluid_msg::OFMsg> create_message(
+            size_t index, MessageList<Messages...>) {
+        using Factory = fluid_msg::OFMsg* (*)();
+        static const Factory factories[] = {&create<Messages>...};
+        return std::unique_ptr<fluid_msg::OFMsg>(factories[index]());
+    }
+
+    static size_t message_index(const RawMessage& raw_message) {
         using namespace fluid_msg;
 
+        if (raw_message.len < HEADER_SIZE) {
+            throw std::logic_error("Message unpack error: Short message");
+        }
+
         switch (raw_message.type) {
         // Symmetric messages
         case of13::OFPT_HELLO:
-            return dispatch<of13::Hello>(raw_message, visitor);
+            return indexOf<of13::Hello>();
         case of13::OFPT_ERROR:
-            return dispatch<of13::Error>(raw_message, visitor);
+            return indexOf<of13::Error>();
         case of13::OFPT_ECHO_REQUEST:
-            return dispatch<of13::EchoRequest>(raw_message, visitor);
+            return indexOf<of13::EchoRequest>();
         case of13::OFPT_ECHO_REPLY:
-            return dispatch<of13::EchoReply>(raw_message, visitor);
+            return indexOf<of13::EchoReply>();
         case of13::OFPT_EXPERIMENTER:
-            return dispatch<of13::Experimenter>(raw_message, visitor);
+            return indexOf<of13::Experimenter>();
 
         // Controller messages
         case of13::OFPT_FEATURES_REQUEST:
-            return dispatch<of13::FeaturesRequest>(raw_message, visitor);
+            return indexOf<of13::FeaturesRequest>();
         case of13::OFPT_GET_CONFIG_REQUEST:
-            return dispatch<of13::GetConfigRequest>(raw_message, visitor);
+            return indexOf<of13::GetConfigRequest>();
         case of13::OFPT_SET_CONFIG:
-            return dispatch<of13::SetConfig>(raw_message, visitor);
+            return indexOf<of13::SetConfig>();
         case of13::OFPT_PACKET_OUT:
-            return dispatch<of13::PacketOut>(raw_message, visitor);
+            return indexOf<of13::PacketOut>();
         case of13::OFPT_FLOW_MOD:
-            return dispatch<of13::FlowMod>(raw_message, visitor);
+            return indexOf<of13::FlowMod>();
         case of13::OFPT_GROUP_MOD:
-            return dispatch<of13::GroupMod>(raw_message, visitor);
+            return indexOf<of13::GroupMod>();
         case of13::OFPT_PORT_MOD:
-            return dispatch<of13::PortMod>(raw_message, visitor);
+            return indexOf<of13::PortMod>();
         case of13::OFPT_TABLE_MOD:
-            return dispatch<of13::TableMod>(raw_message, visitor);
+            return indexOf<of13::TableMod>();
         case of13::OFPT_METER_MOD:
-            return dispatch<of13::MeterMod>(raw_message, visitor);
+            return indexOf<of13::MeterMod>();
         case of13::OFPT_BARRIER_REQUEST:
-            return dispatch<of13::BarrierRequest>(raw_message, visitor);
+            return indexOf<of13::BarrierRequest>();
         case of13::OFPT_QUEUE_GET_CONFIG_REQUEST:
-            return dispatch<of13::QueueGetConfigRequest>(raw_message, visitor);
+            return indexOf<of13::QueueGetConfigRequest>();
         case of13::OFPT_ROLE_REQUEST:
-            return dispatch<of13::RoleRequest>(raw_message, visitor);
+            return indexOf<of13::RoleRequest>();
         case of13::OFPT_GET_ASYNC_REQUEST:
-            return dispatch<of13::GetAsyncRequest>(raw_message, visitor);
+            return indexOf<of13::GetAsyncRequest>();
         case of13::OFPT_SET_ASYNC:
-            return dispatch<of13::SetAsync>(raw_message, visitor);
+            return indexOf<of13::SetAsync>();
         case of13::OFPT_MULTIPART_REQUEST:
-            return dispatch_multipart<of13::MultipartRequest>(raw_message, visitor);
+            return multipart_index(raw_message, false);
 
         // Switch messages
         case of13::OFPT_FEATURES_REPLY:
-            return dispatch<of13::FeaturesReply>(raw_message, visitor);
+            return indexOf<of13::FeaturesReply>();
         case of13::OFPT_GET_CONFIG_REPLY:
-            return dispatch<of13::GetConfigReply>(raw_message, visitor);
+            return indexOf<of13::GetConfigReply>();
         case of13::OFPT_PACKET_IN:
-            return dispatch<of13::PacketIn>(raw_message, visitor);
+            return indexOf<of13::PacketIn>();
         case of13::OFPT_FLOW_REMOVED:
-            return dispatch<of13::FlowRemoved>(raw_message, visitor);
+            return indexOf<of13::FlowRemoved>();
         case of13::OFPT_PORT_STATUS:
-            return dispatch<of13::PortStatus>(raw_message, visitor);
+            return indexOf<of13::PortStatus>();
         case of13::OFPT_BARRIER_REPLY:
-            return dispatch<of13::BarrierReply>(raw_message, visitor);
+            return indexOf<of13::BarrierReply>();
         case of13::OFPT_QUEUE_GET_CONFIG_REPLY:
-            return dispatch<of13::QueueGetConfigReply>(raw_message, visitor);
+            return indexOf<of13::QueueGetConfigReply>();
         case of13::OFPT_ROLE_REPLY:
-            return dispatch<of13::RoleReply>(raw_message, visitor);
+            return indexOf<of13::RoleReply>();
         case of13::OFPT_GET_ASYNC_REPLY:
-            return dispatch<of13::GetAsyncReply>(raw_message, visitor);
+            return indexOf<of13::GetAsyncReply>();
         case of13::OFPT_MULTIPART_REPLY:
-            return dispatch_multipart<of13::MultipartReply>(raw_message, visitor);
+            return multipart_index(raw_message, true);
 
         // Unknown message
         default:
@@ -149,85 +233,144 @@ private:
         }
     }
 
-    template<class MultipartType>
-    ReturnType dispatch_multipart(RawMessage raw_message,
-                                  VisitorInterface& visitor) const {
-        using namespace fluid_msg;
+    template<class Request, class Reply>
+    static size_t multipart_index(bool is_reply) {
+        return is_reply ? indexOf<Reply>() : indexOf<Request>();
+    }
 
-        using IsRequest = std::is_same<MultipartType, of13::MultipartRequest>;
-        using IsReply = std::is_same<MultipartType, of13::MultipartReply>;
-        static_assert(IsRequest::value or IsReply::value,
-                      "Only multipart messages allowed");
+    static size_t multipart_index(const RawMessage& raw_message,
+                                  bool is_reply) {
+        using namespace fluid_msg;
 
-        MultipartType multipart_message;
-        multipart_message.unpack(raw_message.data());
+        if (raw_message.len < MULTIPART_HEADER_SIZE) {
+            throw std::logic_error("Message unpack error: Short multipart");
+        }
+        uint16_t mpart_type;
+        std::memcpy(&mpart_type, raw_message.data() + MULTIPART_TYPE_OFFSET,
+                    sizeof(mpart_type));
+        mpart_type = ntohs(mpart_type);
 
-        switch (multipart_message.mpart_type()) {
+        switch (mpart_type) {
         case of13::OFPMP_DESC:
-            return IsReply::value
-                   ? dispatch<of13::MultipartReplyDesc>(raw_message, visitor)
-                   : dispatch<of13::MultipartRequestDesc>(raw_message, visitor);
+            return multipart_index<of13::MultipartRequestDesc,
+                                   of13::MultipartReplyDesc>(is_reply);
         case of13::OFPMP_FLOW:
-            return IsReply::value
-                   ? dispatch<of13::MultipartReplyFlow>(raw_message, visitor)
-                   : dispatch<of13::MultipartRequestFlow>(raw_message, visitor);
+            return multipart_index<of13::MultipartRequestFlow,
+                                   of13::MultipartReplyFlow>(is_reply);
         case of13::OFPMP_AGGREGATE:
-            return IsReply::value
-                   ? dispatch<of13::MultipartReplyAggregate>(raw_message, visitor)
-                   : dispatch<of13::MultipartRequestAggregate>(raw_message, visitor);
+            return multipart_index<of13::MultipartRequestAggregate,
+                                   of13::MultipartReplyAggregate>(is_reply);
         case of13::OFPMP_TABLE:
-            return IsReply::value
-                   ? dispatch<of13::MultipartReplyTable>(raw_message, visitor)
-                   : dispatch<of13::MultipartRequestTable>(raw_message, visitor);
+            return multipart_index<of13::MultipartRequestTable,
+                                   of13::MultipartReplyTable>(is_reply);
         case of13::OFPMP_PORT_STATS:
-            return IsReply::value
-                   ? dispatch<of13::MultipartReplyPortStats>(raw_message, visitor)
-                   : dispatch<of13::MultipartRequestPortStats>(raw_message, visitor);
+            return multipart_index<of13::MultipartRequestPortStats,
+                                   of13::MultipartReplyPortStats>(is_reply);
         case of13::OFPMP_QUEUE:
-            return IsReply::value
-                   ? dispatch<of13::MultipartReplyQueue>(raw_message, visitor)
-                   : dispatch<of13::MultipartRequestQueue>(raw_message, visitor);
+            return multipart_index<of13::MultipartRequestQueue,
+                                   of13::MultipartReplyQueue>(is_reply);
         case of13::OFPMP_GROUP:
-            return IsReply::value
-                   ? dispatch<of13::MultipartReplyGroup>(raw_message, visitor)
-                   : dispatch<of13::MultipartRequestGroup>(raw_message, visitor);
+            return multipart_index<of13::MultipartRequestGroup,
+                                   of13::MultipartReplyGroup>(is_reply);
         case of13::OFPMP_GROUP_DESC:
-            return IsReply::value
-                   ? dispatch<of13::MultipartReplyGroupDesc>(raw_message, visitor)
-                   : dispatch<of13::MultipartRequestGroupDesc>(raw_message, visitor);
+            return multipart_index<of13::MultipartRequestGroupDesc,
+                                   of13::MultipartReplyGroupDesc>(is_reply);
         case of13::OFPMP_GROUP_FEATURES:
-            return IsReply::value
-                   ? dispatch<of13::MultipartReplyGroupFeatures>(raw_message, visitor)
-                   : dispatch<of13::MultipartRequestGroupFeatures>(raw_message, visitor);
+            return multipart_index<of13::MultipartRequestGroupFeatures,
+                                   of13::MultipartReplyGroupFeatures>(is_reply);
         case of13::OFPMP_METER:
-            return IsReply::value
-                   ? dispatch<of13::MultipartReplyMeter>(raw_message, visitor)
-                   : dispatch<of13::MultipartRequestMeter>(raw_message, visitor);
+            return multipart_index<of13::MultipartRequestMeter,
+                                   of13::MultipartReplyMeter>(is_reply);
         case of13::OFPMP_METER_CONFIG:
-            return IsReply::value
-                   ? dispatch<of13::MultipartReplyMeterConfig>(raw_message, visitor)
-                   : dispatch<of13::MultipartRequestMeterConfig>(raw_message, visitor);
+            return multipart_index<of13::MultipartRequestMeterConfig,
+                                   of13::MultipartReplyMeterConfig>(is_reply);
         case of13::OFPMP_METER_FEATURES:
-            return IsReply::value
-                   ? dispatch<of13::MultipartReplyMeterFeatures>(raw_message, visitor)
-                   : dispatch<of13::MultipartRequestMeterFeatures>(raw_message, visitor);
+            return multipart_index<of13::MultipartRequestMeterFeatures,
+                                   of13::MultipartReplyMeterFeatures>(is_reply);
         case of13::OFPMP_TABLE_FEATURES:
-            return IsReply::value
-                   ? dispatch<of13::MultipartReplyTableFeatures>(raw_message, visitor)
-                   : dispatch<of13::MultipartRequestTableFeatures>(raw_message, visitor);
+            return multipart_index<of13::MultipartRequestTableFeatures,
+                                   of13::MultipartReplyTableFeatures>(is_reply);
         case of13::OFPMP_PORT_DESC:
-            return IsReply::value
-                   ? dispatch<of13::MultipartReplyPortDescription>(raw_message, visitor)
-                   : dispatch<of13::MultipartRequestPortDescription>(raw_message, visitor);
+            return multipart_index<of13::MultipartRequestPortDescription,
+                                   of13::MultipartReplyPortDescription>(is_reply);
         case of13::OFPMP_EXPERIMENTER:
-            return IsReply::value
-                   ? dispatch<of13::MultipartReplyExperimenter>(raw_message, visitor)
-                   : dispatch<of13::MultipartRequestExperimenter>(raw_message, visitor);
+            return multipart_index<of13::MultipartRequestExperimenter,
+                                   of13::MultipartReplyExperimenter>(is_reply);
         default:
             throw std::invalid_argument(
                 "Dispatcher error: Unknown multipart type - " +
-                std::to_string(multipart_message.mpart_type())
+                std::to_string(mpart_type)
             );
         }
     }
 };
+
+template<class ReturnType, class BaseMessage>
+class MessageDispatcher
+{
+public:
+    // TODO: add Args...
+    template<class Message>
+    struct Visitor {
+        virtual ReturnType visit(Message& message) = 0;
+        virtual ~Visitor() = default;
+    };
+
+    // Calls the visitor for the message type or, if there is none, the
+    // visitor for the base message
+    template<class VisitorType>
+    ReturnType operator()(DecodedMessage& message,
+                          VisitorType& visitor) const {
+        auto table = dispatch_table<VisitorType>(OpenFlowMessages());
+        return table[message.index()](visitor, message.message());
+    }
+
+private:
+    template<class VisitorType>
+    using Entry = ReturnType (*)(VisitorType&, fluid_msg::OFMsg&);
+
+    // Visitor overloads are resolved at compile time, one entry per message
+    template<class VisitorType, class... Messages>
+    static const Entry<VisitorType>* dispatch_table(MessageList<Messages...>) {
+        static const Entry<VisitorType> table[] = {
+            &visit_entry<VisitorType, Messages>...
+        };
+        return table;
+    }
+
+    template<class VisitorType, class Message>
+    static ReturnType visit_entry(VisitorType& visitor,
+                                  fluid_msg::OFMsg& message) {
+        return visit_message(
+            visitor, static_cast<Message&>(message),
+            std::is_base_of<Visitor<Message>, VisitorType>()
+        );
+    }
+
+    template<class VisitorType, class Message>
+    static ReturnType visit_message(VisitorType& visitor, Message& message,
+                                    std::true_type) {
+        return static_cast<Visitor<Message>&>(visitor).visit(message);
+    }
+
+    template<class VisitorType, class Message>
+    static ReturnType visit_message(VisitorType& visitor, Message& message,
+                                    std::false_type) {
+        return visit_base(
+            visitor, message,
+            std::is_base_of<Visitor<BaseMessage>, VisitorType>()
+        );
+    }
+
+    template<class VisitorType>
+    static ReturnType visit_base(VisitorType& visitor, BaseMessage& message,
+                                 std::true_type) {
+        return static_cast<Visitor<BaseMessage>&>(visitor).visit(message);
+    }
+
+    template<class VisitorType>
+    static ReturnType visit_base(VisitorType&, BaseMessage&,
+                                 std::false_type) {
+        throw std::invalid_argument("Visitor error: Wrong visitor");
+    }
+};
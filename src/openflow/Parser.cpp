@@ -31,7 +31,13 @@ public:
             std::cerr << "Parser error: Wrong port ID" << std::endl;
             break;
         case SpecialPort::ALL:
-            std::cerr << "Parser error: Unsupported ALL action" << std::endl;
+            actions_.port_actions.emplace_back(
+                Transfer::identityTransfer(), PortType::ALL, SpecialPort::ALL);
+            break;
+        case SpecialPort::IN_PORT:
+            actions_.port_actions.emplace_back(
+                Transfer::identityTransfer(), PortType::IN_PORT,
+                SpecialPort::IN_PORT);
             break;
         case SpecialPort::CONTROLLER:
             actions_.port_actions.emplace_back(PortActionBase::controllerAction());
@@ -102,7 +108,8 @@ of13::MultipartReplyFlow Parser::getMultipartReplyFlow(RuleReplyPtr reply)
     return reply_flow;
 }
 
-of13::MultipartRequestFlow Parser::getMultipartRequestFlow(RuleInfoPtr rule)
+of13::MultipartRequestFlow Parser::getMultipartRequestFlow(RuleInfoPtr rule,
+                                                          Cookie cookie_mask)
 {
     of13::MultipartRequestFlow request_flow;
 
@@ -111,7 +118,7 @@ of13::MultipartRequestFlow Parser::getMultipartRequestFlow(RuleInfoPtr rule)
     request_flow.out_port(of13::OFPP_ANY);
     request_flow.out_group(of13::OFPG_ANY);
     request_flow.cookie(rule->cookie);
-    request_flow.cookie_mask((uint64_t)-1);
+    request_flow.cookie_mask(cookie_mask);
     request_flow.match(get_of_match(rule->match));
 
     return request_flow;
@@ -230,11 +237,44 @@ ActionsBase Parser::get_actions(of13::InstructionSet instructions)
     return actions_bridge.popActionsBase();
 }
 
+GroupInfo Parser::getGroupInfo(SwitchId switch_id, of13::GroupMod& message)
+{
+    GroupType type;
+    switch (message.group_type()) {
+    case of13::OFPGT_ALL:
+        type = GroupType::ALL;
+        break;
+    case of13::OFPGT_SELECT:
+        type = GroupType::SELECT;
+        break;
+    case of13::OFPGT_INDIRECT:
+        type = GroupType::INDIRECT;
+        break;
+    case of13::OFPGT_FF:
+    default:
+        type = GroupType::FAST_FAILOVER;
+        break;
+    }
+
+    std::vector<ActionsBase> buckets;
+    for (auto& bucket : message.buckets()) {
+        auto actions = bucket.get_actions();
+        buckets.push_back(get_action_list(actions.action_set()).popActionsBase());
+    }
+    return {switch_id, message.group_id(), type, std::move(buckets)};
+}
+
 Parser::ActionsBaseBridge
 Parser::get_apply_actions(of13::ApplyActions* actions)
+{
+    return get_action_list(actions->actions().action_list());
+}
+
+template<class ActionList>
+Parser::ActionsBaseBridge Parser::get_action_list(const ActionList& action_list)
 {
     ActionsBaseBridge actions_bridge;
-    for (auto action : actions->actions().action_list()) {
+    for (auto action : action_list) {
         switch (action->type()) {
         case of13::OFPAT_OUTPUT: {
             auto output_action = dynamic_cast<of13::OutputAction*>(action);
@@ -350,6 +390,10 @@ of13::InstructionSet Parser::get_of_instructions(ActionsBase actions)
             output_action = new of13::OutputAction(
                 of13::OFPP_ALL, of13::OFPCML_NO_BUFFER);
             break;
+        case SpecialPort::IN_PORT:
+            output_action = new of13::OutputAction(
+                of13::OFPP_IN_PORT, of13::OFPCML_NO_BUFFER);
+            break;
         case SpecialPort::CONTROLLER:
             output_action = new of13::OutputAction(
                 of13::OFPP_CONTROLLER, of13::OFPCML_NO_BUFFER);
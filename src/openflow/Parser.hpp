@@ -42,10 +42,13 @@ public:
                 std::move(match), ActionsBase()};
     }
 
+    static GroupInfo getGroupInfo(SwitchId switch_id, of13::GroupMod& message);
+
     static of13::FlowMod getFlowMod(RuleInfoPtr rule);
     static of13::FlowStats getFlowStats(RuleInfoPtr rule, RuleStatsFields stats);
     static of13::MultipartReplyFlow getMultipartReplyFlow(RuleReplyPtr reply);
-    static of13::MultipartRequestFlow getMultipartRequestFlow(RuleInfoPtr rule);
+    static of13::MultipartRequestFlow getMultipartRequestFlow(
+        RuleInfoPtr rule, Cookie cookie_mask = EXACT_COOKIE_MASK);
 
 protected:
     // TODO: rewrite fluid_msg so we do not need to copy match (add const)
@@ -54,6 +57,8 @@ protected:
 
     static ActionsBase get_actions(of13::InstructionSet instructions);
     static ActionsBaseBridge get_apply_actions(of13::ApplyActions* actions);
+    template<class ActionList>
+    static ActionsBaseBridge get_action_list(const ActionList& action_list);
     static Transfer get_transfer(const of13::SetFieldAction* action);
     static of13::InstructionSet get_of_instructions(ActionsBase actions);
 };
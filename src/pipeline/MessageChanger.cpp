@@ -4,7 +4,7 @@ namespace pipeline {
 
 using namespace fluid_msg;
 
-RawMessage MessageChanger::visit(of13::FlowMod& flow_mod)
+bool MessageChanger::visit(of13::FlowMod& flow_mod)
 {
     if (not isLLDP(flow_mod)) {
         flow_mod.table_id(flow_mod.table_id() + 1);
@@ -12,26 +12,27 @@ RawMessage MessageChanger::visit(of13::FlowMod& flow_mod)
     else {
         flow_mod.cookie(0x11D);
     }
-    return {flow_mod};
+    return true;
 }
 
-RawMessage MessageChanger::visit(of13::MultipartRequestFlow& request_flow)
+bool MessageChanger::visit(of13::MultipartRequestFlow& request_flow)
 {
     request_flow.table_id(request_flow.table_id() + 1);
-    return {request_flow};
+    return true;
 }
 
-RawMessage MessageChanger::visit(of13::MultipartReplyFlow& reply_flow)
+bool MessageChanger::visit(of13::MultipartReplyFlow& reply_flow)
 {
     for (auto& flow_stats : reply_flow.flow_stats()) {
         flow_stats.table_id(flow_stats.table_id() - 1);
     }
-    return {reply_flow};
+    return true;
 }
 
-RawMessage MessageChanger::visit(OFMsg& message)
+bool MessageChanger::visit(OFMsg&)
 {
-    return {message};
+    // The original bytes are forwarded without packing
+    return false;
 }
 
 } // namespace pipeline
@@ -13,14 +13,14 @@ struct MessageChanger : public Changer<fluid_msg::of13::FlowMod>,
                         public HandlerBase
 {
     // Controller messages
-    RawMessage visit(fluid_msg::of13::FlowMod& flow_mod) override;
-    RawMessage visit(fluid_msg::of13::MultipartRequestFlow&) override;
+    bool visit(fluid_msg::of13::FlowMod& flow_mod) override;
+    bool visit(fluid_msg::of13::MultipartRequestFlow&) override;
 
     // Switch messages
-    RawMessage visit(fluid_msg::of13::MultipartReplyFlow&) override;
+    bool visit(fluid_msg::of13::MultipartReplyFlow&) override;
 
-    // Default
-    RawMessage visit(fluid_msg::OFMsg&) override;
+    // Default, leaves the message unchanged
+    bool visit(fluid_msg::OFMsg&) override;
 };
 
 } // namespace pipeline
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "../Proto.hpp"
+#include "../Types.hpp"
+
+#include <fluid/of13/openflow-13.h>
+
+#include <arpa/inet.h>
+#include <cstddef>
+#include <cstring>
+
+namespace pipeline {
+
+// Classifies messages by their header bytes without unpacking them. Only
+// the messages that the pipeline handlers change or observe need to be
+// dispatched, the others are forwarded as they are.
+class MessageClassifier
+{
+public:
+    static bool isPassThrough(const RawMessage& raw_message) {
+        using namespace fluid_msg;
+
+        auto data = raw_message.data();
+        if (raw_message.len < HEADER_SIZE ||
+                of13::OFP_VERSION != data[VERSION_OFFSET]) {
+            return false;
+        }
+
+        switch (raw_message.type) {
+        case of13::OFPT_FLOW_MOD:
+        case of13::OFPT_GROUP_MOD:
+            return false;
+        case of13::OFPT_MULTIPART_REQUEST:
+        case of13::OFPT_MULTIPART_REPLY:
+            return raw_message.len >= MULTIPART_HEADER_SIZE &&
+                   of13::OFPMP_FLOW != read16(data + MULTIPART_TYPE_OFFSET);
+        case of13::OFPT_PACKET_IN:
+            // Link discovery handles LLDP packets
+            return not may_be_lldp(raw_message);
+        default:
+            return true;
+        }
+    }
+
+private:
+    static constexpr size_t VERSION_OFFSET = 0u;
+    static constexpr size_t HEADER_SIZE = 8u;
+    static constexpr size_t MULTIPART_TYPE_OFFSET = 8u;
+    static constexpr size_t MULTIPART_HEADER_SIZE = 16u;
+    // Packet-In fields that precede the match
+    static constexpr size_t PACKET_IN_MATCH_OFFSET = 24u;
+    static constexpr size_t MATCH_HEADER_SIZE = 4u;
+    static constexpr size_t PACKET_IN_PAD_SIZE = 2u;
+
+    static uint16_t read16(const uint8_t* data) {
+        uint16_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return ntohs(value);
+    }
+
+    // Returns true for malformed messages, so they are dispatched and
+    // reported by libfluid
+    static bool may_be_lldp(const RawMessage& raw_message) {
+        auto data = raw_message.data();
+        auto len = raw_message.len;
+        if (len < PACKET_IN_MATCH_OFFSET + MATCH_HEADER_SIZE) {
+            return true;
+        }
+
+        // The match is padded to a multiple of 8 bytes
+        auto match_len = (size_t)read16(data + PACKET_IN_MATCH_OFFSET + 2u);
+        auto padded_match_len = (match_len + 7u) / 8u * 8u;
+        auto frame_offset = PACKET_IN_MATCH_OFFSET + padded_match_len +
+                            PACKET_IN_PAD_SIZE;
+        if (len < frame_offset + sizeof(proto::Ethernet)) {
+            return true;
+        }
+
+        auto frame = data + frame_offset;
+        auto eth_type = read16(frame + offsetof(proto::Ethernet, type));
+        if (proto::Ethernet::TYPE::DOT1Q == eth_type) {
+            auto dot1q_offset = frame_offset + sizeof(proto::Ethernet);
+            if (len < dot1q_offset + sizeof(proto::Dot1Q)) {
+                return true;
+            }
+            eth_type = read16(data + dot1q_offset +
+                              offsetof(proto::Dot1Q, type));
+        }
+        return proto::Ethernet::TYPE::LLDP == eth_type;
+    }
+};
+
+} // namespace pipeline
@@ -46,6 +46,31 @@ Action MessageHandler::visit(of13::FlowMod& flow_mod)
     return Action::ENQUEUE;
 }
 
+Action MessageHandler::visit(of13::GroupMod& group_mod)
+{
+    auto switch_id = ctrl_.switch_manager.getSwitch(connection_id_)->id;
+    switch (group_mod.command()) {
+    case of13::OFPGC_ADD:
+        ctrl_.detector.addGroup(Parser::getGroupInfo(switch_id, group_mod));
+        break;
+    case of13::OFPGC_MODIFY:
+        ctrl_.detector.changeGroup(Parser::getGroupInfo(switch_id, group_mod));
+        break;
+    case of13::OFPGC_DELETE:
+        if (of13::OFPG_ALL == group_mod.group_id()) {
+            ctrl_.detector.deleteAllGroups(switch_id);
+        }
+        else {
+            ctrl_.detector.deleteGroup(switch_id, group_mod.group_id());
+        }
+        break;
+    default:
+        std::cerr << "Unknown group mod command" << std::endl;
+        break;
+    }
+    return Action::ENQUEUE;
+}
+
 Action MessageHandler::visit(of13::PacketOut& packet_out)
 {
     // TODO: compute path and add stats to the detector
@@ -83,7 +108,10 @@ Action MessageHandler::visit(of13::PacketIn& packet_in)
 Action MessageHandler::visit(of13::MultipartReplyFlow& reply_flow)
 {
     //std::cout<<"~~~~~STATS REPLIED ("<<reply_flow.xid()<<")~~~~~"<<std::endl;
-    auto result = ctrl_.stats_manager.popRequestId(reply_flow.xid());
+    // A coalesced reply may be split into several messages
+    bool last_part = not (reply_flow.flags() & of13::OFPMPF_REPLY_MORE);
+    auto result = ctrl_.stats_manager.popRequestId(reply_flow.xid(),
+                                                   last_part);
     if (result.second) {
         auto request_id = result.first;
         auto switch_id = ctrl_.switch_manager.getSwitch(connection_id_)->id;
@@ -94,6 +122,9 @@ Action MessageHandler::visit(of13::MultipartReplyFlow& reply_flow)
             ctrl_.detector.addRuleStats(request_id, std::move(rule_info),
                                         get_rule_stats(flow_stats));
         }
+        if (last_part) {
+            ctrl_.detector.completeRuleStats(request_id);
+        }
 
         // This message is not for the controller
         return Action::DROP;
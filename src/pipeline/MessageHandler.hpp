@@ -8,6 +8,7 @@
 namespace pipeline {
 
 class MessageHandler : public Visitor<fluid_msg::of13::FlowMod>,
+                       public Visitor<fluid_msg::of13::GroupMod>,
                        public Visitor<fluid_msg::of13::PacketOut>,
                        public Visitor<fluid_msg::of13::PacketIn>,
                        public Visitor<fluid_msg::of13::MultipartReplyFlow>,
@@ -22,6 +23,7 @@ public:
 
     // Controller messages
     Action visit(fluid_msg::of13::FlowMod&) override;
+    Action visit(fluid_msg::of13::GroupMod&) override;
     Action visit(fluid_msg::of13::PacketOut&) override;
     Action visit(fluid_msg::of13::MultipartRequestFlow&) override;
 
@@ -8,26 +8,161 @@
 
 namespace pipeline {
 
+Pipeline::Pipeline(Sender sender, Controller& controller,
+                   size_t shard_number):
+    sender_(sender), controller_(controller), next_shard_(0u)
+{
+    if (0u == shard_number) {
+        shard_number = DEFAULT_SHARD_NUMBER;
+    }
+    for (size_t i = 0; i < shard_number; i++) {
+        shards_.push_back(std::make_unique<Shard>());
+    }
+}
+
 void Pipeline::addConnection(ConnectionId id)
 {
-    auto handshake_it = handshake_pipelines_.find(id);
-    auto handler_it = message_handlers_.find(id);
-    if (handshake_pipelines_.end() == handshake_it &&
-        message_handlers_.end() == handler_it) {
+    Shard* shard;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto shard_it = connection_shards_.find(id);
+        if (connection_shards_.end() != shard_it) {
+            shard = shard_it->second;
+        }
+        else {
+            // Round robin keeps the number of connections per shard even
+            shard = shards_[next_shard_].get();
+            next_shard_ = (next_shard_ + 1u) % shards_.size();
+            connection_shards_.emplace(id, shard);
+        }
+    }
+    shard->worker.addTask([this, shard, id]() {
+        add_connection(*shard, id);
+    });
+}
+
+void Pipeline::deleteConnection(ConnectionId id)
+{
+    Shard* shard = get_shard(id);
+    if (shard) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            connection_shards_.erase(id);
+        }
+        // Runs after the messages received before the deletion
+        shard->worker.addTask([shard, id]() {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            shard->message_handlers.erase(id);
+        });
+    }
+}
+
+void Pipeline::processMessage(Message message)
+{
+    Shard* shard = get_shard(message.connection_id);
+    if (shard) {
+        shard->worker.addTask(
+            [this, shard, message = std::move(message)]() mutable {
+                process_message(*shard, std::move(message));
+            }
+        );
+    }
+    else {
+        std::cerr << "Pipeline error: Unknown connection id="
+                  << message.connection_id << std::endl;
+    }
+}
+
+void Pipeline::addBarrier(std::function<void()> on_passed)
+{
+    // Shards pass the barrier independently and the last one calls
+    // on_passed, so a busy shard does not stall the others. The messages
+    // that a shard handles after the barrier are released no earlier than
+    // by the next flush.
+    auto barrier = std::make_shared<Barrier>(shards_.size(),
+                                             std::move(on_passed));
+    for (auto& shard : shards_) {
+        auto shard_ptr = shard.get();
+        shard->worker.addTask([this, shard_ptr, barrier]() {
+            pass_barrier(*shard_ptr, barrier);
+        });
+    }
+}
+
+void Pipeline::flushPipeline()
+{
+    bool is_flushed = false;
+    for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        if (not shard->queue.empty()) {
+            auto messages = shard->queue.pop();
+            //std::cout<<"Flush ("<<shard->queue.size()<<") -> "<<messages.size()<<std::endl;
+            for (auto& queued_message : messages) {
+                auto postprocessor_it = shard->message_postprocessors.find(
+                    queued_message.message.connection_id
+                );
+                assert(shard->message_postprocessors.end() !=
+                       postprocessor_it);
+                auto& message_postprocessor = postprocessor_it->second;
+
+                PostprocessorDispatcher()(queued_message.decoded,
+                                          message_postprocessor);
+                forward_message(queued_message.message,
+                                queued_message.decoded);
+            }
+            is_flushed = true;
+        }
+    }
+    if (is_flushed) {
+        controller_.performance_monitor.flush();
+    }
+}
+
+void Pipeline::stop()
+{
+    for (auto& shard : shards_) {
+        shard->worker.stop();
+    }
+}
+
+size_t Pipeline::queueSize() const
+{
+    size_t size = 0u;
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        size += shard->queue.size();
+    }
+    return size;
+}
+
+Pipeline::Shard* Pipeline::get_shard(ConnectionId id)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto shard_it = connection_shards_.find(id);
+    return connection_shards_.end() != shard_it ? shard_it->second : nullptr;
+}
+
+void Pipeline::add_connection(Shard& shard, ConnectionId id)
+{
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto handshake_it = shard.handshake_pipelines.find(id);
+    auto handler_it = shard.message_handlers.find(id);
+    if (shard.handshake_pipelines.end() == handshake_it &&
+        shard.message_handlers.end() == handler_it) {
         // Create message handler
-        handshake_pipelines_.emplace(
+        shard.handshake_pipelines.emplace(
             id, HandshakePipeline(id, controller_)
         );
-        message_handlers_.emplace(
+        shard.message_handlers.emplace(
             id, MessageHandler(id, controller_)
         );
     }
     else {
         std::cerr << "Pipeline error: Already existing connection" << std::endl;
     }
-    auto postprocessor_it = message_postprocessors_.find(id);
-    if (message_postprocessors_.end() == postprocessor_it) {
-        message_postprocessors_.emplace(
+    auto postprocessor_it = shard.message_postprocessors.find(id);
+    if (shard.message_postprocessors.end() == postprocessor_it) {
+        shard.message_postprocessors.emplace(
             id, MessagePostprocessor(id, controller_)
         );
     }
@@ -36,30 +171,25 @@ void Pipeline::addConnection(ConnectionId id)
     }
 }
 
-void Pipeline::deleteConnection(ConnectionId id)
+void Pipeline::process_message(Shard& shard, Message message)
 {
-    message_handlers_.erase(id);
-}
-
-void Pipeline::processMessage(Message message)
-{
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::lock_guard<std::mutex> lock(shard.mutex);
     // Check if the connection hasn't been established yet
-    auto handshake_it = handshake_pipelines_.find(message.connection_id);
-    if (handshake_pipelines_.end() != handshake_it) {
+    auto handshake_it = shard.handshake_pipelines.find(message.connection_id);
+    if (shard.handshake_pipelines.end() != handshake_it) {
         try {
             // Dispatch message
             auto &pipeline = handshake_it->second;
-            auto pre_action = Dispatcher()(message.raw_message,
-                                           pipeline.handler);
+            DecodedMessage decoded(message.raw_message);
+            auto pre_action = Dispatcher()(decoded, pipeline.handler);
 
             // Process message
             switch (pre_action) {
             case Action::FORWARD:
-                handle_message(message);
+                handle_message(shard, std::move(message), std::move(decoded));
                 break;
             case Action::ENQUEUE:
-                pipeline.queue.push(message);
+                pipeline.queue.emplace(std::move(message), std::move(decoded));
                 break;
             case Action::DROP:
                 break;
@@ -69,79 +199,85 @@ void Pipeline::processMessage(Message message)
             if (pipeline.handler.established()) {
                 // Handle queued messages
                 while (not pipeline.queue.empty()) {
-                    auto queued_message = pipeline.queue.front();
+                    auto& queued_message = pipeline.queue.front();
+                    handle_message(shard, std::move(queued_message.message),
+                                   std::move(queued_message.decoded));
                     pipeline.queue.pop();
-                    handle_message(queued_message);
                 }
 
                 // Delete handshake pipeline for the established connection
-                handshake_pipelines_.erase(handshake_it);
+                shard.handshake_pipelines.erase(handshake_it);
             }
         }
         catch (const std::invalid_argument& error) {
             std::cerr << "Pipeline process error: " << error.what() << std::endl;
-            handle_message(message);
+            handle_message(shard, message);
         }
         catch (const std::logic_error& error) {
             std::cerr << "Pipeline process error: " << error.what() << std::endl;
-            handle_message(message);
+            handle_message(shard, message);
         }
     }
+    else if (MessageClassifier::isPassThrough(message.raw_message)) {
+        forward_message(message);
+    }
     else {
-        handle_message(message);
+        handle_message(shard, std::move(message));
     }
 }
 
-void Pipeline::addBarrier()
+void Pipeline::pass_barrier(Shard& shard,
+                            const std::shared_ptr<Barrier>& barrier)
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    queue_.addBarrier();
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.queue.addBarrier();
+    }
+    if (1u == barrier->remaining_shards.fetch_sub(1u) &&
+            barrier->on_passed) {
+        barrier->on_passed();
+    }
 }
 
-void Pipeline::flushPipeline()
+void Pipeline::handle_message(Shard& shard, Message message)
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    if (not queue_.empty()) {
-        auto messages = queue_.pop();
-        //std::cout<<"Flush ("<<queue_.size()<<") -> "<<messages.size()<<std::endl;
-        for (auto message : messages) {
-            auto postprocessor_it = message_postprocessors_.find(
-                message.connection_id
-            );
-            assert(message_postprocessors_.end() != postprocessor_it);
-            auto& message_postprocessor = postprocessor_it->second;
-
-            PostprocessorDispatcher()(message.raw_message,
-                                      message_postprocessor);
-            forward_message(message);
-        }
-        controller_.performance_monitor.flush();
+    try {
+        DecodedMessage decoded(message.raw_message);
+        handle_message(shard, std::move(message), std::move(decoded));
+    }
+    catch (const std::invalid_argument& error) {
+        std::cerr << "Pipeline process error: " << error.what() << std::endl;
+        forward_message(message);
+    }
+    catch (const std::logic_error& error) {
+        std::cerr << "Pipeline process error: " << error.what() << std::endl;
+        forward_message(message);
     }
 }
 
-void Pipeline::handle_message(Message message)
+void Pipeline::handle_message(Shard& shard, Message message,
+                              DecodedMessage decoded)
 {
-    auto handler_it = message_handlers_.find(message.connection_id);
+    auto handler_it = shard.message_handlers.find(message.connection_id);
     // TODO: delete connections correctly
-    assert(message_handlers_.end() != handler_it);
+    assert(shard.message_handlers.end() != handler_it);
     auto& message_handler = handler_it->second;
     try {
         // Dispatch message
-        auto action = Dispatcher()(message.raw_message, message_handler);
+        auto action = Dispatcher()(decoded, message_handler);
 
         // Change message
-        auto new_message = Message(
-            message.connection_id, message.origin,
-            ChangerDispatcher()(message.raw_message, message_changer_)
-        );
+        if (ChangerDispatcher()(decoded, shard.message_changer)) {
+            decoded.markDirty();
+        }
 
         // Process message
         switch (action) {
         case Action::FORWARD:
-            forward_message(new_message);
+            forward_message(message, decoded);
             break;
         case Action::ENQUEUE:
-            enqueue_message(new_message);
+            enqueue_message(shard, {std::move(message), std::move(decoded)});
             break;
         case Action::DROP:
             break;
@@ -157,14 +293,25 @@ void Pipeline::handle_message(Message message)
     }
 }
 
-void Pipeline::forward_message(Message message)
+void Pipeline::forward_message(const Message& message)
 {
     sender_.send(message);
 }
 
-void Pipeline::enqueue_message(Message message)
+void Pipeline::forward_message(Message& message, const DecodedMessage& decoded)
+{
+    // Unchanged messages keep their original bytes
+    if (decoded.dirty()) {
+        message.raw_message = decoded.encode();
+    }
+    sender_.send(message);
+}
+
+void Pipeline::enqueue_message(Shard& shard, DecodedPipelineMessage message)
 {
-    queue_.push(std::move(message));
+    // Queued messages are released by the next detector instruction
+    shard.queue.push(std::move(message));
+    controller_.detector.scheduleTick();
 }
 
 } // namespace pipeline
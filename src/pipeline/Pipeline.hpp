@@ -4,52 +4,104 @@
 #include "MessageHandler.hpp"
 #include "MessageChanger.hpp"
 #include "MessagePostprocessor.hpp"
+#include "MessageClassifier.hpp"
+#include "../ConcurrencyPrimitives.hpp"
 #include "../Types.hpp"
 #include "../Controller.hpp"
 
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <queue>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace pipeline {
 
 class Pipeline
 {
+    // Message decoded once for all the pipeline stages
+    struct DecodedPipelineMessage {
+        DecodedPipelineMessage(Message message, DecodedMessage decoded):
+            message(std::move(message)), decoded(std::move(decoded)) {}
+
+        Message message;
+        DecodedMessage decoded;
+    };
+
     struct HandshakePipeline {
         HandshakePipeline(ConnectionId id, Controller& controller):
             handler(id, controller) {}
 
         HandshakeHandler handler;
-        std::queue<Message> queue;
+        std::queue<DecodedPipelineMessage> queue;
+    };
+
+    // Connections are spread between shards, each shard handles the
+    // messages of its connections on its own worker in their arrival order
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<ConnectionId, HandshakePipeline> handshake_pipelines;
+        std::unordered_map<ConnectionId, MessageHandler> message_handlers;
+        MessageChanger message_changer;
+        std::unordered_map<ConnectionId,
+                           MessagePostprocessor> message_postprocessors;
+        QueueWithBarriers<DecodedPipelineMessage> queue;
+
+        // Destroyed first, so the worker is joined before the state it uses
+        Executor worker;
+    };
+
+    struct Barrier {
+        Barrier(size_t shard_number, std::function<void()>&& on_passed):
+            remaining_shards(shard_number), on_passed(std::move(on_passed)) {}
+
+        std::atomic<size_t> remaining_shards;
+        std::function<void()> on_passed;
     };
 
 public:
-    Pipeline(Sender sender, Controller& controller):
-        sender_(sender), controller_(controller) {}
+    // As many shards as the proxy has connection threads
+    static constexpr size_t DEFAULT_SHARD_NUMBER = 4;
+
+    Pipeline(Sender sender, Controller& controller, size_t shard_number = 0);
 
     void addConnection(ConnectionId id);
     void deleteConnection(ConnectionId id);
     void processMessage(Message message);
 
-    void addBarrier();
+    // Calls on_passed once every shard has handled the messages received
+    // before the barrier
+    void addBarrier(std::function<void()> on_passed = {});
     void flushPipeline();
+    // Handles the received messages and stops the shard workers
+    void stop();
 
-    size_t queueSize() const {return queue_.size();}
+    size_t queueSize() const;
 
 private:
     Sender sender_;
     Controller& controller_;
 
-    std::unordered_map<ConnectionId, HandshakePipeline> handshake_pipelines_;
-    std::unordered_map<ConnectionId, MessageHandler> message_handlers_;
-    MessageChanger message_changer_;
-    std::unordered_map<ConnectionId,
-                       MessagePostprocessor> message_postprocessors_;
-
+    std::vector<std::unique_ptr<Shard>> shards_;
     std::mutex mutex_;
-    QueueWithBarriers<Message> queue_;
+    std::unordered_map<ConnectionId, Shard*> connection_shards_;
+    size_t next_shard_;
+
+    Shard* get_shard(ConnectionId id);
+
+    void add_connection(Shard& shard, ConnectionId id);
+    void process_message(Shard& shard, Message message);
+    void pass_barrier(Shard& shard, const std::shared_ptr<Barrier>& barrier);
 
-    void handle_message(Message message);
-    void forward_message(Message message);
-    void enqueue_message(Message message);
+    void handle_message(Shard& shard, Message message);
+    void handle_message(Shard& shard, Message message,
+                        DecodedMessage decoded);
+    void forward_message(const Message& message);
+    void forward_message(Message& message, const DecodedMessage& decoded);
+    void enqueue_message(Shard& shard, DecodedPipelineMessage message);
 };
 
 } // namespace pipeline
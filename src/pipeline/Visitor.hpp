@@ -12,7 +12,8 @@ enum class Action {
 using Dispatcher = MessageDispatcher<Action, fluid_msg::OFMsg>;
 template<class Message> using Visitor = Dispatcher::Visitor<Message>;
 
-using ChangerDispatcher = MessageDispatcher<RawMessage, fluid_msg::OFMsg>;
+// Changers return true if they have changed the message
+using ChangerDispatcher = MessageDispatcher<bool, fluid_msg::OFMsg>;
 template<class Message> using Changer = ChangerDispatcher::Visitor<Message>;
 
 using PostprocessorDispatcher = MessageDispatcher<void, fluid_msg::OFMsg>;
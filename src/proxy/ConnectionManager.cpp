@@ -27,8 +27,10 @@ void Client::connection_callback(OFConnection* connection,
 void Client::message_callback(OFConnection* connection, uint8_t type,
                               void* data, size_t len)
 {
-    RawMessage message(type, data, len);
-    connection_manager_->onControllerMessage(connection, message);
+    // The message keeps the received bytes until it is sent or dropped
+    auto buffer = MessageBuffer::adopt(data, len, &OFServer::free_data);
+    RawMessage message(type, std::move(buffer), len);
+    connection_manager_->onControllerMessage(connection, std::move(message));
 }
 
 Server::Server(ConnectionManager* connection_manager,
@@ -54,8 +56,9 @@ void Server::connection_callback(OFConnection* connection,
 void Server::message_callback(OFConnection* connection, uint8_t type,
                               void* data, size_t len)
 {
-    RawMessage message(type, data, len);
-    connection_manager_->onSwitchMessage(connection, message);
+    auto buffer = MessageBuffer::adopt(data, len, &OFServer::free_data);
+    RawMessage message(type, std::move(buffer), len);
+    connection_manager_->onSwitchMessage(connection, std::move(message));
 }
 
 ConnectionManager::ConnectionManager(ProxySettings settings,
@@ -84,7 +87,8 @@ ConnectionManager::ConnectionManager(ProxySettings settings,
     );
 }
 
-void ConnectionManager::sendToController(ConnectionId id, RawMessage message)
+void ConnectionManager::sendToController(ConnectionId id,
+                                         const RawMessage& message)
 {
     auto it = connections_.find(id);
     if (connections_.end() != it) {
@@ -99,7 +103,8 @@ void ConnectionManager::sendToController(ConnectionId id, RawMessage message)
     }
 }
 
-void ConnectionManager::sendToSwitch(ConnectionId id, RawMessage message)
+void ConnectionManager::sendToSwitch(ConnectionId id,
+                                     const RawMessage& message)
 {
     auto it = connections_.find(id);
     if (connections_.end() != it) {
@@ -218,7 +223,7 @@ void ConnectionManager::onSwitchMessage(OFConnection* connection,
 
         // Queue messages
         auto& message_queue = waiting_it->second.message_queue;
-        message_queue.push(message);
+        message_queue.push(std::move(message));
     }
     else {
         auto it = connections_.find(connection_id);
@@ -332,7 +337,8 @@ void ConnectionManager::delete_proxy_connection(OFConnection* connection)
     }
 }
 
-void ConnectionManager::send(OFConnection* connection, RawMessage message)
+void ConnectionManager::send(OFConnection* connection,
+                             const RawMessage& message)
 {
     connection->send(message.data(), message.len);
 }
@@ -75,8 +75,8 @@ private:
 public:
     ConnectionManager(ProxySettings settings, EventQueue& event_queue);
 
-    void sendToController(ConnectionId id, RawMessage message);
-    void sendToSwitch(ConnectionId id, RawMessage message);
+    void sendToController(ConnectionId id, const RawMessage& message);
+    void sendToSwitch(ConnectionId id, const RawMessage& message);
 
     void onControllerConnection(OFConnection* connection,
                                 OFConnection::Event type);
@@ -107,6 +107,6 @@ private:
                               OFConnection* switch_connection);
     void delete_proxy_connection(OFConnection* connection);
 
-    void send(OFConnection* connection, RawMessage message);
+    void send(OFConnection* connection, const RawMessage& message);
 
 };
@@ -8,6 +8,7 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 class Sender
 {
@@ -18,11 +19,11 @@ public:
     // TODO: add const to add pack functions in fluid_msg
     void send(ConnectionId id, Destination destination,
               fluid_msg::OFMsg& message) {
-        RawMessage raw_message(message);
-        send(id, destination, std::move(raw_message));
+        send(id, destination, RawMessage(message));
     }
 
-    void send(ConnectionId id, Destination destination, RawMessage message) {
+    void send(ConnectionId id, Destination destination,
+              const RawMessage& message) {
         if (auto manager = connection_manager_.lock()) {
             if (destination == Destination::TO_CONTROLLER) {
                 //std::cout<<"Send to controller"<<std::endl;
@@ -38,7 +39,7 @@ public:
         }
     }
 
-    void send(Message message) {
+    void send(const Message& message) {
         send(message.connection_id, message.destination, message.raw_message);
     }
 
@@ -57,12 +58,12 @@ public:
         );
     }
 
-    bool eventsExist() {
+    bool eventsExist() const {
         return not event_queue_.empty();
     }
 
-    EventPtr getEvent() {
-        return event_queue_.pop();
+    size_t popEvents(std::vector<EventPtr>& events) {
+        return event_queue_.popAll(events);
     }
 
     Sender getSender() const {
@@ -5,6 +5,7 @@
 #include "../../src/network/DependencyGraph.hpp"
 
 #include <algorithm>
+#include <bitset>
 #include <memory>
 #include <set>
 
@@ -378,6 +379,33 @@ TEST_F(DependencyGraphTest, DeleteLinkTest)
     EXPECT_TRUE(expected_removed_edges.empty());
 }
 
+TEST_F(DependencyGraphTest, LinkFlapTest)
+{
+    dependency_graph->addRule(rule1);
+    dependency_graph->addRule(rule2);
+    dependency_graph->popEdgeDiff();
+
+    // Edge domains of the second link are taken from the memo
+    std::list<Dependency> link_edges[2];
+    for (auto& edges : link_edges) {
+        auto link = network->addLink({1,2}, {2,1}).first;
+        dependency_graph->addLink(link);
+        edges = dependency_graph->popEdgeDiff().new_edges;
+        network->deleteLink({1,2}, {2,1});
+        dependency_graph->deleteLink(link);
+        dependency_graph->popEdgeDiff();
+    }
+
+    ASSERT_EQ(2u, link_edges[1].size());
+    auto edge_it = link_edges[1].begin();
+    for (const auto& edge : link_edges[0]) {
+        EXPECT_EQ(edge.src, edge_it->src);
+        EXPECT_EQ(edge.dst, edge_it->dst);
+        EXPECT_EQ(edge.domain, edge_it->domain);
+        edge_it++;
+    }
+}
+
 TEST_F(DependencyGraphTest, EdgeCleanUpTest)
 {
     network->deleteRule(rule1->id());
@@ -428,3 +456,208 @@ TEST_F(DependencyGraphTest, TableRuleTest)
     EXPECT_EQ(table1_rule, out_edge.dst_rule);
     EXPECT_EQ(N(1, H("00000011")), out_edge.domain);
 }
+
+TEST_F(DependencyGraphTest, GroupTest)
+{
+    ActionsBase flood_actions;
+    flood_actions.port_actions.emplace_back(
+        Transfer::identityTransfer(), PortType::ALL, SpecialPort::ALL);
+    std::vector<ActionsBase> buckets{ActionsBase::portAction(2),
+                                     std::move(flood_actions)};
+    auto group = network->addGroup(
+        GroupInfo(1, 1, GroupType::ALL, std::move(buckets)));
+    ASSERT_NE(nullptr, group);
+    // Flooding bucket is split by the input port
+    ASSERT_EQ(3u, group->buckets().size());
+    auto port_bucket = group->buckets()[0];
+    auto flood_bucket = group->buckets()[1];
+    EXPECT_EQ(1u, flood_bucket->inPort());
+    EXPECT_EQ(2u, group->buckets()[2]->inPort());
+
+    auto out_degree = [this](RulePtr rule) -> size_t {
+        size_t degree = 0;
+        for (auto edge : dependency_graph->outEdges(rule)) {
+            (void)edge;
+            degree++;
+        }
+        return degree;
+    };
+    dependency_graph->addGroup(group);
+    auto group_diff = dependency_graph->popEdgeDiff();
+    EXPECT_EQ(6u, group_diff.new_edges.size());
+    EXPECT_EQ(1u, out_degree(port_bucket));
+    EXPECT_EQ(1u, out_degree(flood_bucket));
+    auto bucket_edge = findEdgeFrom(group_diff.new_edges, port_bucket);
+    EXPECT_EQ(port12->sinkRule(), bucket_edge.dst_rule);
+    auto flood_edge = findEdgeFrom(group_diff.new_edges, flood_bucket);
+    EXPECT_EQ(port12->sinkRule(), flood_edge.dst_rule);
+
+    // Rules share the group fan-out
+    ActionsBase group_actions;
+    group_actions.group_actions.emplace_back(Transfer::identityTransfer(), 1);
+    auto rule = network->addRule(1, 0, 1, 0x0, M(1, B("0000xxxx")),
+                                 std::move(group_actions));
+    ASSERT_NE(nullptr, rule);
+    dependency_graph->addRule(rule);
+    auto rule_diff = dependency_graph->popEdgeDiff();
+    ASSERT_EQ(1u, rule_diff.new_edges.size());
+    auto group_edge = findEdgeFrom(rule_diff.new_edges, rule);
+    EXPECT_EQ(group->groupRule(), group_edge.dst_rule);
+    EXPECT_EQ(N(1, H("0000xxxx")), group_edge.domain);
+
+    // Group modification keeps the edges from the rule
+    dependency_graph->deleteGroup(group);
+    buckets.clear();
+    buckets.push_back(ActionsBase::dropAction());
+    network->modifyGroup(GroupInfo(1, 1, GroupType::ALL, std::move(buckets)));
+    dependency_graph->addGroup(group);
+    dependency_graph->popEdgeDiff();
+    EXPECT_EQ(1u, out_degree(rule));
+    EXPECT_EQ(1u, out_degree(group->groupRule()));
+    auto drop_bucket = group->buckets()[0];
+    auto drop_edge = *dependency_graph->outEdges(drop_bucket).begin();
+    EXPECT_EQ(network->dropRule(), drop_edge->dst->rule);
+
+    // Chained groups are rejected
+    ActionsBase chain_actions;
+    chain_actions.group_actions.emplace_back(Transfer::identityTransfer(), 1);
+    buckets.clear();
+    buckets.push_back(std::move(chain_actions));
+    EXPECT_EQ(nullptr, network->addGroup(
+        GroupInfo(1, 2, GroupType::ALL, std::move(buckets))));
+}
+
+TEST_F(DependencyGraphTest, ParallelLinkTest)
+{
+    // Both links lead to the same rule, but through different ports
+    auto actions = ActionsBase::portAction(1);
+    actions += ActionsBase::portAction(2);
+    auto src_rule = network->addRule(1, 0, 2, 0x0, M(B("0001xxxx")),
+                                     std::move(actions));
+    auto dst_rule = network->addRule(2, 0, 2, 0x0, M(B("0001xxxx")),
+                                     ActionsBase::dropAction());
+    dependency_graph->addRule(rule1);
+    dependency_graph->addRule(rule2);
+    dependency_graph->addRule(src_rule);
+    dependency_graph->addRule(dst_rule);
+    dependency_graph->addLink(network->addLink({1,1}, {2,1}).first);
+    dependency_graph->addLink(network->addLink({1,2}, {2,2}).first);
+    dependency_graph->popEdgeDiff();
+
+    std::set<PortId> in_ports;
+    for (auto edge : dependency_graph->inEdges(dst_rule)) {
+        if (src_rule != edge->src->rule) continue;
+        auto in_port = edge->domain.inPort();
+        EXPECT_EQ(N(in_port, H("0001xxxx")), edge->domain);
+        in_ports.insert(in_port);
+    }
+    EXPECT_EQ(std::set<PortId>({1, 2}), in_ports);
+}
+
+class ParallelDependencyGraphTest : public ::testing::Test
+{
+protected:
+    struct LinkNetwork : public SimpleTwoSwitchNetwork {
+        explicit LinkNetwork(std::shared_ptr<WorkStealingPool> pool) {
+            initNetwork();
+            graph = std::make_shared<DependencyGraph>(network, pool);
+            graph->addRule(network->dropRule());
+            graph->addRule(network->controllerRule());
+            for (auto port : {port11, port12, port21, port22}) {
+                graph->addRule(port->sourceRule());
+                graph->addRule(port->sinkRule());
+            }
+            for (auto rule : {table_miss1, table_miss2, rule1, rule2}) {
+                graph->addRule(rule);
+            }
+            for (unsigned i = 0; i < 128; i++) {
+                auto bits = std::bitset<8>(i << 1).to_string();
+                graph->addRule(network->addRule(
+                    2, 0, 2, 0x0, M(1, B(bits.c_str())),
+                    ActionsBase::portAction(2)
+                ));
+            }
+            graph->popEdgeDiff();
+        }
+
+        ~LinkNetwork() {
+            graph.reset();
+            destroyNetwork();
+        }
+
+        EdgeDiff addLink() {
+            graph->addLink(network->addLink({1,2}, {2,1}).first);
+            return graph->popEdgeDiff();
+        }
+
+        EdgeDiff addRules(bool in_batch) {
+            std::vector<RulePtr> rules;
+            for (auto priority : {3, 2, 4}) {
+                rules.push_back(network->addRule(
+                    1, 0, priority, 0x0, M(1, B("00000xxx")),
+                    ActionsBase::portAction(2)
+                ));
+                rules.push_back(network->addRule(
+                    2, 0, priority + 1, 0x0, M(1, B("0000xxx0")),
+                    ActionsBase::portAction(2)
+                ));
+                if (not in_batch) {
+                    graph->addRule(rules[rules.size() - 2]);
+                    graph->addRule(rules.back());
+                }
+            }
+            if (in_batch) {
+                graph->addRules(rules);
+            }
+            return graph->popEdgeDiff();
+        }
+
+        std::shared_ptr<DependencyGraph> graph;
+    };
+
+    // Edges must be installed in the same order with the same domains
+    void expectSameEdges(const std::list<Dependency>& expected_edges,
+                         const std::list<Dependency>& edges) const {
+        ASSERT_EQ(expected_edges.size(), edges.size());
+        auto it = edges.begin();
+        for (const auto& expected_edge : expected_edges) {
+            EXPECT_EQ(expected_edge.src->domain(), it->src->domain());
+            EXPECT_EQ(expected_edge.dst->domain(), it->dst->domain());
+            EXPECT_EQ(expected_edge.domain, it->domain);
+            it++;
+        }
+    }
+};
+
+TEST_F(ParallelDependencyGraphTest, AddLinkTest)
+{
+    auto pool = std::make_shared<WorkStealingPool>(3);
+    LinkNetwork sequential(nullptr);
+    LinkNetwork parallel(pool);
+
+    auto sequential_diff = sequential.addLink();
+    auto parallel_diff = parallel.addLink();
+    ASSERT_FALSE(sequential_diff.new_edges.empty());
+    expectSameEdges(sequential_diff.new_edges, parallel_diff.new_edges);
+}
+
+TEST_F(ParallelDependencyGraphTest, AddRulesTest)
+{
+    auto pool = std::make_shared<WorkStealingPool>(3);
+    LinkNetwork sequential(nullptr);
+    LinkNetwork parallel(pool);
+    sequential.addLink();
+    parallel.addLink();
+
+    auto sequential_diff = sequential.addRules(false);
+    auto parallel_diff = parallel.addRules(true);
+    ASSERT_FALSE(sequential_diff.new_edges.empty());
+    ASSERT_FALSE(sequential_diff.changed_edges.empty());
+    expectSameEdges(sequential_diff.new_edges, parallel_diff.new_edges);
+    expectSameEdges(sequential_diff.new_dependent_edges,
+                    parallel_diff.new_dependent_edges);
+    expectSameEdges(sequential_diff.changed_edges,
+                    parallel_diff.changed_edges);
+    expectSameEdges(sequential_diff.removed_edges,
+                    parallel_diff.removed_edges);
+}
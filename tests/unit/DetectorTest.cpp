@@ -0,0 +1,88 @@
+#include "gtest/gtest.h"
+
+#include "../../src/Detector.hpp"
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+class DetectorTest : public ::testing::Test
+{
+protected:
+    using B = BitMask;
+    using M = Match;
+
+    virtual void SetUp() {
+        alarm = std::make_shared<Alarm>(std::chrono::milliseconds(1000));
+        detector = std::make_unique<Detector>(alarm, 1u);
+    }
+
+    virtual void TearDown() {
+        detector.reset();
+        alarm.reset();
+    }
+
+    void addSwitch() {
+        std::vector<PortInfo> ports{{1,0}, {2,0}};
+        detector->addSwitch(SwitchInfo(1, 1, ports));
+
+        // The instruction is prepared after the switch is added
+        detector->prepareInstructions();
+        std::vector<Instruction> instructions;
+        while (0u == detector->popInstructions(instructions)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    RuleInfo ruleInfo() const {
+        return RuleInfo(1, 0, 1, 0x0, M(1, B("0000xxxx")),
+                        ActionsBase::portAction(2));
+    }
+
+    std::shared_ptr<Alarm> alarm;
+    std::unique_ptr<Detector> detector;
+};
+
+TEST_F(DetectorTest, RuleStatsOrderTest)
+{
+    addSwitch();
+
+    // The controller expects its rule in the reply to a later request
+    testing::internal::CaptureStdout();
+    detector->addRule(ruleInfo());
+    detector->getRuleStats(1u, ruleInfo());
+    detector->stop();
+    auto output = testing::internal::GetCapturedStdout();
+    EXPECT_EQ(std::string::npos, output.find("No matching rules"));
+}
+
+TEST_F(DetectorTest, RuleStatsOvertakeTest)
+{
+    addSwitch();
+
+    // The instruction queue holds 1024 instructions, so the detector thread
+    // waits in the next preparation until they are popped
+    for (size_t i = 0; i < 1025u; i++) {
+        detector->prepareInstructions();
+    }
+    while (detector->instructionNumber() < 1024u) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    testing::internal::CaptureStdout();
+    auto measurement = std::make_shared<PerformanceMeasurement>("", 0u, 0u);
+    detector->fillMeasurement(measurement);
+    detector->addRule(ruleInfo());
+    detector->getRuleStats(1u, ruleInfo());
+
+    std::vector<Instruction> instructions;
+    detector->popInstructions(instructions);
+    detector->stop();
+    auto output = testing::internal::GetCapturedStdout();
+
+    // The request has already finished when the earlier task runs
+    EXPECT_EQ(1u, measurement->queue_depth);
+    EXPECT_EQ(std::string::npos, output.find("No matching rules"));
+}
@@ -0,0 +1,37 @@
+#include "gtest/gtest.h"
+
+#include "../../src/ConcurrencyPrimitives.hpp"
+
+#include <chrono>
+#include <future>
+#include <thread>
+
+TEST(ExecutorTest, StopFromTaskTest)
+{
+    std::promise<void> stopped;
+    bool later_task_done = false;
+    {
+        Executor executor;
+        executor.addTask([&executor, &stopped]() {
+            executor.stop(Executor::StopPolicy::DROP);
+            stopped.set_value();
+        });
+        stopped.get_future().wait();
+        executor.addTask([&later_task_done]() {
+            later_task_done = true;
+        });
+    }
+    EXPECT_FALSE(later_task_done);
+}
+
+TEST(ExecutorDeathTest, DestroyFromTaskTest)
+{
+    ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+    EXPECT_DEATH({
+        auto executor = new Executor;
+        executor->addTask([executor]() {
+            delete executor;
+        });
+        std::this_thread::sleep_for(std::chrono::seconds(10));
+    }, "");
+}
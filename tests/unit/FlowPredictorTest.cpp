@@ -13,12 +13,12 @@ protected:
         xid_generator = std::make_shared<RequestIdGenerator>();
         stats_manager = std::make_shared<StatsManager>(xid_generator);
 
-        node1 = nodes.emplace(nodes.end(),
-            Node(1u, rule1, NetworkSpace::wholeSpace(),
-                Transfer::identityTransfer(), 1u));
-        node2 = nodes.emplace(nodes.end(),
-            Node(2u, rule2, NetworkSpace::wholeSpace(),
-                Transfer::identityTransfer(), 1u));
+        space = std::make_unique<NodeSpace>(NetworkSpace::wholeSpace(),
+                                            Transfer::identityTransfer());
+        node1 = &*nodes.emplace(nodes.end(),
+            Node(1u, rule1, space.get(), 1u));
+        node2 = &*nodes.emplace(nodes.end(),
+            Node(2u, rule2, space.get(), 1u));
         path = domain_paths.emplace(domain_paths.end(),
             DomainPath(1u, node1, node2, TimestampFactory().createTimestamp()));
     }
@@ -34,6 +34,7 @@ protected:
     std::shared_ptr<RequestIdGenerator> xid_generator;
     std::shared_ptr<StatsManager> stats_manager;
 
+    std::unique_ptr<NodeSpace> space;
     std::list<Node> nodes;
     std::list<DomainPath> domain_paths;
     NodePtr node1, node2;
@@ -80,6 +81,126 @@ TEST_F(StatsManagerTest, BasicTest)
     EXPECT_EQ(packet_count, rule_stats->stats_fields.packet_count);
 }
 
+TEST_F(StatsManagerTest, AdaptiveBucketTest)
+{
+    stats_manager = std::make_shared<StatsManager>(xid_generator, 1u, 2u);
+
+    // Quiet ticks keep the front timestamp
+    auto time = stats_manager->frontTime();
+    EXPECT_TRUE(stats_manager->getNewRequests(false).data.empty());
+    EXPECT_EQ(time, stats_manager->frontTime());
+    EXPECT_TRUE(stats_manager->getNewRequests(true).data.empty());
+    EXPECT_NE(time, stats_manager->frontTime());
+
+    stats_manager->requestRule(rule1);
+    EXPECT_FALSE(stats_manager->requestsReady());
+    stats_manager->requestRule(rule2);
+    EXPECT_TRUE(stats_manager->requestsReady());
+    auto first_requests = stats_manager->getNewRequests(false);
+    EXPECT_EQ(2u, first_requests.data.size());
+    EXPECT_EQ(1u, stats_manager->outstandingBuckets());
+
+    // Requests wait while too many buckets are outstanding
+    stats_manager->requestRule(rule1);
+    stats_manager->requestRule(rule2);
+    EXPECT_FALSE(stats_manager->requestsReady());
+    EXPECT_TRUE(stats_manager->getNewRequests(false).data.empty());
+    stats_manager->requestRule(rule1);
+    for (auto request : first_requests.data) {
+        stats_manager->passRequest(request);
+    }
+    EXPECT_EQ(2u, stats_manager->popStatsList().stats.size());
+    EXPECT_TRUE(stats_manager->popStatsList().stats.empty());
+    EXPECT_EQ(3u, stats_manager->getNewRequests(false).data.size());
+}
+
+TEST_F(StatsManagerTest, InterceptorRequestTest)
+{
+    auto path2 = domain_paths.emplace(domain_paths.end(),
+        DomainPath(2u, node1, node2, TimestampFactory().createTimestamp()));
+    for (auto domain_path : {path, path2}) {
+        domain_path->interceptor = rule1->info();
+        domain_path->interceptor->cookie = INTERCEPTOR_COOKIE | domain_path->id;
+    }
+
+    // Paths of one switch are queried at once and every interceptor once
+    stats_manager->requestPath(path);
+    stats_manager->requestPath(path2);
+    stats_manager->requestPath(path);
+    auto requests = stats_manager->getNewRequests();
+    ASSERT_EQ(1u, requests.data.size());
+    auto request = InterceptorRequest::pointerCast(requests.data[0]);
+    ASSERT_NE(nullptr, request);
+    EXPECT_EQ(INTERCEPTOR_COOKIE_MASK, request->cookie_mask);
+    EXPECT_EQ(2u, request->interceptors.size());
+
+    // The reply is split between path stats by cookie
+    request->addStats(path->interceptor->cookie, {10u, 100u});
+    request->addStats(path2->interceptor->cookie, {20u, 200u});
+    stats_manager->passRequest(request);
+    auto stats_list = stats_manager->popStatsList();
+    ASSERT_EQ(3u, stats_list.stats.size());
+    for (const auto& stats : stats_list.stats) {
+        auto path_stats = std::dynamic_pointer_cast<PathStats>(stats);
+        ASSERT_NE(nullptr, path_stats);
+        auto packet_count = (path_stats->path == path) ? 10u : 20u;
+        EXPECT_EQ(packet_count, path_stats->source_stats_fields.packet_count);
+    }
+}
+
+class PathScanTest : public ::testing::Test
+                   , public SimpleTwoSwitchNetwork
+{
+protected:
+    using H = HeaderSpace;
+    using N = NetworkSpace;
+
+    virtual void SetUp() {
+        initNetwork();
+        path_scan = std::make_unique<PathScan>();
+    }
+
+    virtual void TearDown() {
+        path_scan.reset();
+        destroyNetwork();
+    }
+
+    std::unique_ptr<PathScan> path_scan;
+};
+
+TEST_F(PathScanTest, NodeDomainTest)
+{
+    auto sink = path_scan->addRootNode(port11->sinkRule());
+    auto node = path_scan->addChildNode(sink, rule1, N(1, H("0000xxxx")),
+                                        Transfer::identityTransfer(), 1u);
+    path_scan->addNodeCounter(node, RuleStatsFields{10u, 100u});
+
+    // Traffic of the old domain is not counted for the new one
+    path_scan->setNodeDomain(node, N(1, H("000000xx")));
+    EXPECT_EQ(N(1, H("000000xx")), path_scan->node(node).domain());
+    EXPECT_EQ(0u, path_scan->node(node).counter.packet_count);
+    EXPECT_EQ(10u, path_scan->getRuleCounter(rule1).packet_count);
+}
+
+TEST_F(PathScanTest, NodeSpaceTest)
+{
+    auto sink = path_scan->addRootNode(port11->sinkRule());
+    auto node1 = path_scan->addChildNode(sink, rule1, N(1, H("0000xxxx")),
+                                         Transfer::identityTransfer(), 1u);
+    auto node2 = path_scan->addChildNode(sink, rule2, N(1, H("0000xxxx")),
+                                         Transfer::identityTransfer(), 1u);
+    EXPECT_EQ(path_scan->node(node1).space, path_scan->node(node2).space);
+    EXPECT_EQ(2u, path_scan->spaceNumber());
+
+    // Changed domain moves the node to its own space
+    path_scan->setNodeDomain(node2, N(1, H("000000xx")));
+    EXPECT_NE(path_scan->node(node1).space, path_scan->node(node2).space);
+    EXPECT_EQ(3u, path_scan->spaceNumber());
+    path_scan->setNodeDomain(node2, N(1, H("0000xxxx")));
+    EXPECT_EQ(path_scan->node(node1).space, path_scan->node(node2).space);
+    EXPECT_EQ(2u, path_scan->spaceNumber());
+}
+
 class FlowPredictorTest : public ::testing::Test
                         , public SimpleTwoSwitchGraph
 {
@@ -103,7 +224,7 @@ protected:
         initGraph();
         xid_generator = std::make_shared<RequestIdGenerator>();
         flow_predictor = std::make_shared<FlowPredictor>(dependency_graph,
-                                                         xid_generator);
+                                                         xid_generator, pool);
     }
 
     void updateSpecialRuleEdges() {
@@ -176,31 +297,26 @@ protected:
         return (it != rules.end()) ? *it : nullptr;
     }
 
-    RuleInfoPtr getRequestedRule(SwitchId sw_id, NetworkSpace domain,
-                             const RequestList& request_list) {
-        auto it = std::find_if(
-            request_list.data.begin(), request_list.data.end(),
-            [sw_id, domain](RequestPtr request) {
-                auto rule_request = RuleRequest::pointerCast(request);
-                if (not rule_request) return false;
-
-                auto rule = rule_request->rule;
-                if (rule->switch_id) {
-                    return rule->switch_id == sw_id &&
-                        rule->match == domain.match();
-                }
-                return false;
+    std::list<RuleInfoPtr> getRequestedRules(
+            const RequestList& request_list) {
+        std::list<RuleInfoPtr> rules;
+        for (const auto& request : request_list.data) {
+            auto interceptor_request = InterceptorRequest::pointerCast(request);
+            if (interceptor_request) {
+                rules.insert(rules.end(),
+                             interceptor_request->interceptors.begin(),
+                             interceptor_request->interceptors.end());
             }
-        );
-        if (it != request_list.data.end()) {
-            auto rule_request = RuleRequest::pointerCast(*it);
-            return rule_request->rule;
-        }
-        else {
-            return nullptr;
         }
+        return rules;
     }
 
+    RuleInfoPtr getRequestedRule(SwitchId sw_id, NetworkSpace domain,
+                                 const RequestList& request_list) {
+        return getRule(sw_id, domain, getRequestedRules(request_list));
+    }
+
+    std::shared_ptr<WorkStealingPool> pool;
     std::shared_ptr<RequestIdGenerator> xid_generator;
     std::shared_ptr<FlowPredictor> flow_predictor;
 };
@@ -245,9 +361,10 @@ TEST_F(FlowPredictorTest, AddRuleTest)
     // Check rule1 requests
     ASSERT_EQ(1u, rule1_instruction.requests.data.size());
     auto request = *rule1_instruction.requests.data.begin();
-    auto rule_request = RuleRequest::pointerCast(request);
-    ASSERT_NE(nullptr, rule_request);
-    EXPECT_EQ(*table_miss_source1, *rule_request->rule);
+    auto interceptor_request = InterceptorRequest::pointerCast(request);
+    ASSERT_NE(nullptr, interceptor_request);
+    ASSERT_EQ(1u, interceptor_request->interceptors.size());
+    EXPECT_EQ(*table_miss_source1, *interceptor_request->interceptors[0]);
 
     // Check rule1 new rules
     auto& rule1_new_rules = rule1_instruction.interceptor_diff.rules_to_add;
@@ -283,8 +400,9 @@ TEST_F(FlowPredictorTest, DeleteRuleTest)
     flow_predictor->updateEdges(diff);
     auto instruction = flow_predictor->getInstruction();
 
-    // Check requests
-    EXPECT_EQ(2u, instruction.requests.data.size());
+    // Check requests, both interceptors are queried at once
+    EXPECT_EQ(1u, instruction.requests.data.size());
+    EXPECT_EQ(2u, getRequestedRules(instruction.requests).size());
     auto requested_rule1 = getRequestedRule(
         1u, N(1, H("0000xxxx")), instruction.requests
     );
@@ -310,6 +428,57 @@ TEST_F(FlowPredictorTest, DeleteRuleTest)
     ASSERT_NE(nullptr, deleted_rule2);
 }
 
+TEST_F(FlowPredictorTest, UnchangedEdgeTest)
+{
+    updateAllRules();
+    auto path_scan_size = flow_predictor->pathScanSize();
+
+    // Edges with the same domains keep their nodes and interceptors
+    EdgeDiff diff;
+    for (auto edge : dependency_graph->inEdges(table_miss1)) {
+        diff.changed_edges.emplace_back(edge);
+    }
+    ASSERT_FALSE(diff.changed_edges.empty());
+    flow_predictor->updateEdges(diff);
+    auto instruction = flow_predictor->getInstruction();
+
+    EXPECT_TRUE(instruction.requests.data.empty());
+    EXPECT_TRUE(instruction.interceptor_diff.empty());
+    EXPECT_EQ(path_scan_size, flow_predictor->pathScanSize());
+}
+
+TEST_F(FlowPredictorTest, ReleaseNodesTest)
+{
+    std::vector<RequestPtr> requests;
+    auto save_requests = [this, &requests]() {
+        auto instruction = flow_predictor->getInstruction();
+        requests.insert(requests.end(), instruction.requests.data.begin(),
+                        instruction.requests.data.end());
+    };
+    save_requests();
+    updateFirstRuleEdges();
+    save_requests();
+    updateSecondRuleEdges();
+    save_requests();
+
+    // Delete rule
+    dependency_graph->deleteRule(rule1);
+    auto diff = dependency_graph->popEdgeDiff();
+    flow_predictor->updateEdges(diff);
+    save_requests();
+
+    // Old nodes are kept until their stats are processed
+    auto path_scan_size = flow_predictor->pathScanSize();
+    flow_predictor->getInstruction();
+    EXPECT_EQ(path_scan_size, flow_predictor->pathScanSize());
+
+    for (auto request : requests) {
+        flow_predictor->passRequest(request);
+    }
+    flow_predictor->getInstruction();
+    EXPECT_GT(path_scan_size, flow_predictor->pathScanSize());
+}
+
 TEST_F(FlowPredictorTest, AddLinkTest)
 {
     updateAllRules();
@@ -318,8 +487,9 @@ TEST_F(FlowPredictorTest, AddLinkTest)
     updateLinkInstallation();
     auto instruction = flow_predictor->getInstruction();
 
-    // Check requests
-    EXPECT_EQ(4u, instruction.requests.data.size());
+    // Check requests, there is one request per switch
+    EXPECT_EQ(2u, instruction.requests.data.size());
+    EXPECT_EQ(4u, getRequestedRules(instruction.requests).size());
     auto requested_rule1 = getRequestedRule(
         1u, N(1, H("0000xxxx")), instruction.requests
     );
@@ -380,7 +550,8 @@ TEST_F(FlowPredictorTest, DeleteLinkTest)
     auto instruction = flow_predictor->getInstruction();
 
     // Check requests
-    EXPECT_EQ(2u, instruction.requests.data.size());
+    EXPECT_EQ(1u, instruction.requests.data.size());
+    EXPECT_EQ(2u, getRequestedRules(instruction.requests).size());
     auto requested_rule1 = getRequestedRule(
         1u, N(1, H("0000xxxx") & H("000000xx")), instruction.requests
     );
@@ -427,3 +598,21 @@ TEST_F(FlowPredictorTest, PredictionTest)
 {
     updateAllRules();
 }
+
+TEST_F(FlowPredictorTest, ParallelPredictionTest)
+{
+    auto predict = [this]() {
+        updateAllRules();
+        flow_predictor->predictFlow(
+            1u, {table_miss1, rule1, rule2, table_miss2}
+        );
+        return flow_predictor->getInstruction().requests.data.size();
+    };
+    auto sequential_request_number = predict();
+    EXPECT_LT(0u, sequential_request_number);
+
+    TearDown();
+    pool = std::make_shared<WorkStealingPool>(3);
+    SetUp();
+    EXPECT_EQ(sequential_request_number, predict());
+}
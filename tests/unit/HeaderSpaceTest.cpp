@@ -241,6 +241,26 @@ TEST_F(HeaderSpaceTest, NetworkSpaceTest)
     EXPECT_EQ(N(1, empty()), N(zeros()) & N(1, ones()));
 }
 
+TEST_F(HeaderSpaceTest, IdenticalTest)
+{
+    EXPECT_TRUE(H("xx0011xx").isIdentical(H("xx0011xx")));
+    EXPECT_EQ(H("xx0011xx").hash(), H("xx0011xx").hash());
+    EXPECT_FALSE(H("xx0011xx").isIdentical(H("xx0011x1")));
+    EXPECT_TRUE((whole() - zeros()).isIdentical(whole() - zeros()));
+    EXPECT_EQ((whole() - zeros()).hash(), (whole() - zeros()).hash());
+    EXPECT_FALSE((whole() - zeros()).isIdentical(whole()));
+    auto empty_diff = (whole() - zeros()) & ones();
+    EXPECT_TRUE(empty_diff.isIdentical(ones()));
+    EXPECT_EQ(empty_diff.hash(), ones().hash());
+
+    EXPECT_TRUE(T("xx0011xx").isIdentical(T("xx0011xx")));
+    EXPECT_EQ(T("xx0011xx").hash(), T("xx0011xx").hash());
+    EXPECT_FALSE(T("xx0011xx").isIdentical(identity()));
+
+    EXPECT_TRUE(N(1, zeros()).isIdentical(N(1, zeros())));
+    EXPECT_FALSE(N(1, zeros()).isIdentical(N(2, zeros())));
+}
+
 TEST_F(HeaderSpaceTest, BitVectorTest)
 {
     auto bit_vector = BitMask::wholeSpace(header_length_);
@@ -0,0 +1,57 @@
+#include "gtest/gtest.h"
+
+#include "../../src/MessageBuffer.hpp"
+
+#include <cstring>
+#include <vector>
+
+namespace {
+int released_number = 0;
+
+void release(void* data)
+{
+    released_number++;
+    delete[] reinterpret_cast<uint8_t*>(data);
+}
+}
+
+TEST(MessageBufferTest, AllocateTest)
+{
+    EXPECT_EQ(0u, MessageBufferPool::sizeClass(1));
+    EXPECT_TRUE(MessageBufferPool::HEAP_CLASS ==
+                MessageBufferPool::sizeClass(1u << 20));
+
+    std::vector<MessageBuffer> buffers;
+    for (size_t size : {8u, 100u, 1000u, 70000u}) {
+        auto buffer = MessageBuffer::allocate(size);
+        ASSERT_TRUE((bool)buffer);
+        EXPECT_EQ(size, buffer.size());
+        std::memset(buffer.data(), 0xab, size);
+        buffers.push_back(std::move(buffer));
+    }
+
+    // Freed blocks are reused by the same size class
+    auto data = buffers[1].data();
+    buffers[1] = MessageBuffer();
+    EXPECT_EQ(data, MessageBuffer::allocate(100u).data());
+}
+
+TEST(MessageBufferTest, AdoptTest)
+{
+    released_number = 0;
+    auto data = new uint8_t[16];
+    {
+        auto buffer = MessageBuffer::adopt(data, 16u, &release);
+        EXPECT_EQ(data, buffer.data());
+        EXPECT_EQ(1u, buffer.useCount());
+
+        // Copies share the bytes
+        auto copy = buffer;
+        EXPECT_EQ(2u, buffer.useCount());
+        EXPECT_EQ(data, copy.data());
+        auto moved = std::move(copy);
+        EXPECT_FALSE((bool)copy);
+        EXPECT_EQ(2u, moved.useCount());
+    }
+    EXPECT_EQ(1, released_number);
+}
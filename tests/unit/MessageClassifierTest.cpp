@@ -0,0 +1,65 @@
+#include "gtest/gtest.h"
+
+#include "../../src/Proto.hpp"
+#include "../../src/pipeline/MessageClassifier.hpp"
+
+#include <fluid/of13/openflow-13.h>
+#include <fluid/of13msg.hh>
+
+#include <vector>
+
+using namespace fluid_msg;
+using pipeline::MessageClassifier;
+
+static std::vector<uint8_t> ethernetFrame(uint16_t type)
+{
+    // Destination and source addresses followed by the type
+    std::vector<uint8_t> frame(sizeof(proto::Ethernet) + 16u, 0u);
+    frame[12] = type >> 8;
+    frame[13] = type & 0xff;
+    return frame;
+}
+
+static RawMessage packetIn(std::vector<uint8_t> frame)
+{
+    of13::PacketIn packet_in;
+    packet_in.buffer_id(0xffffffffu);
+    packet_in.total_len(frame.size());
+    packet_in.add_oxm_field(new of13::InPort(1u));
+    packet_in.data(frame.data(), frame.size());
+    return RawMessage(packet_in);
+}
+
+TEST(MessageClassifierTest, TypeTest)
+{
+    of13::EchoRequest echo(1u);
+    EXPECT_TRUE(MessageClassifier::isPassThrough(RawMessage(echo)));
+
+    of13::FlowMod flow_mod;
+    EXPECT_FALSE(MessageClassifier::isPassThrough(RawMessage(flow_mod)));
+
+    of13::MultipartRequestPortStats port_request(1u, 0u, of13::OFPP_ANY);
+    EXPECT_TRUE(MessageClassifier::isPassThrough(RawMessage(port_request)));
+
+    of13::MultipartRequestFlow flow_request;
+    flow_request.table_id(of13::OFPTT_ALL);
+    flow_request.out_port(of13::OFPP_ANY);
+    flow_request.out_group(of13::OFPG_ANY);
+    EXPECT_FALSE(MessageClassifier::isPassThrough(RawMessage(flow_request)));
+
+    EXPECT_FALSE(MessageClassifier::isPassThrough(RawMessage()));
+}
+
+TEST(MessageClassifierTest, PacketInTest)
+{
+    auto ipv4 = packetIn(ethernetFrame(proto::Ethernet::TYPE::IPv4));
+    EXPECT_TRUE(MessageClassifier::isPassThrough(ipv4));
+
+    auto lldp = packetIn(ethernetFrame(proto::Ethernet::TYPE::LLDP));
+    EXPECT_FALSE(MessageClassifier::isPassThrough(lldp));
+
+    auto frame = ethernetFrame(proto::Ethernet::TYPE::DOT1Q);
+    frame[sizeof(proto::Ethernet) + 2u] = proto::Ethernet::TYPE::LLDP >> 8;
+    frame[sizeof(proto::Ethernet) + 3u] = proto::Ethernet::TYPE::LLDP & 0xff;
+    EXPECT_FALSE(MessageClassifier::isPassThrough(packetIn(frame)));
+}
@@ -0,0 +1,65 @@
+#include "gtest/gtest.h"
+
+#include "../../src/openflow/MessageDispatcher.hpp"
+
+#include <fluid/of13/openflow-13.h>
+#include <fluid/of13msg.hh>
+
+using namespace fluid_msg;
+
+using TestDispatcher = MessageDispatcher<int, OFMsg>;
+
+struct TestVisitor : public TestDispatcher::Visitor<of13::FlowMod>,
+                     public TestDispatcher::Visitor<of13::MultipartReplyFlow>,
+                     public TestDispatcher::Visitor<OFMsg>
+{
+    int visit(of13::FlowMod& flow_mod) override {
+        flow_mod.table_id(flow_mod.table_id() + 1);
+        return 1;
+    }
+    int visit(of13::MultipartReplyFlow&) override {return 2;}
+    int visit(OFMsg&) override {return 0;}
+};
+
+struct FlowModVisitor : public TestDispatcher::Visitor<of13::FlowMod>
+{
+    int visit(of13::FlowMod&) override {return 1;}
+};
+
+TEST(MessageDispatcherTest, DispatchTest)
+{
+    TestVisitor visitor;
+    FlowModVisitor flow_mod_visitor;
+
+    of13::MultipartReplyFlow reply_flow;
+    DecodedMessage decoded_reply(RawMessage{reply_flow});
+    EXPECT_TRUE(DecodedMessage::indexOf<of13::MultipartReplyFlow>() ==
+                decoded_reply.index());
+    EXPECT_EQ(2, TestDispatcher()(decoded_reply, visitor));
+    EXPECT_THROW(TestDispatcher()(decoded_reply, flow_mod_visitor),
+                 std::invalid_argument);
+
+    of13::EchoRequest echo(1u);
+    DecodedMessage decoded_echo(RawMessage{echo});
+    EXPECT_EQ(0, TestDispatcher()(decoded_echo, visitor));
+}
+
+TEST(MessageDispatcherTest, EncodeTest)
+{
+    of13::FlowMod flow_mod;
+    flow_mod.table_id(1u);
+    RawMessage raw_message(flow_mod);
+
+    // Every visitor sees the same decoded message
+    TestVisitor visitor;
+    DecodedMessage decoded(raw_message);
+    EXPECT_EQ(1, TestDispatcher()(decoded, visitor));
+    EXPECT_EQ(1, TestDispatcher()(decoded, visitor));
+    EXPECT_FALSE(decoded.dirty());
+
+    decoded.markDirty();
+    auto encoded = decoded.encode();
+    of13::FlowMod changed_flow_mod;
+    ASSERT_EQ(0, changed_flow_mod.unpack(encoded.data()));
+    EXPECT_EQ(3u, changed_flow_mod.table_id());
+}
@@ -3,6 +3,7 @@
 #include "ExampleNetwork.hpp"
 #include "../../src/NetworkSpace.hpp"
 #include "../../src/network/Network.hpp"
+#include "../../src/network/RuleOperations.hpp"
 
 #include <memory>
 #include <set>
@@ -137,6 +138,11 @@ TEST_F(NetworkTest, TableRuleTest)
     ASSERT_NE(nullptr, found_rule);
     EXPECT_EQ(rule11->id(), found_rule->id());
 
+    EXPECT_EQ(1u, rule11->id().switchId());
+    EXPECT_EQ(1u, rule11->id().tableId());
+    EXPECT_EQ(rule11->priority(), rule11->id().priority());
+    EXPECT_EQ(rule2, sw1->table(0)->rule(rule2->priority(), rule2->match()));
+
     auto deleted_rule = sw1->table(0)->rule(deleted_rule5_id_);
     EXPECT_EQ(nullptr, deleted_rule);
 
@@ -194,3 +200,116 @@ TEST_F(NetworkTest, PortRuleTest)
     network->deleteRule(rule4->id());
     EXPECT_FALSE(port11->srcRules().begin() != port11->srcRules().end());
 }
+
+TEST(RuleOperationBufferTest, CoalescingTest)
+{
+    using B = BitMask;
+    using M = Match;
+    auto rule_info = [](Priority priority, const char* header,
+                        PortId out_port) {
+        return RuleInfo(1, 0, priority, 0x0, M(1, B(header)),
+                        ActionsBase::portAction(out_port));
+    };
+
+    RuleOperationBuffer buffer;
+    EXPECT_TRUE(buffer.empty());
+
+    // Repeated changes of one rule are merged with its addition
+    buffer.addRule(rule_info(2, "0000xxxx", 2));
+    buffer.changeRule(rule_info(2, "0000xxxx", 3));
+    buffer.changeRule(rule_info(2, "0000xxxx", 4));
+    buffer.addRule(rule_info(2, "0000xxxx", 5));
+    // Different priority and match are different rules
+    buffer.changeRule(rule_info(1, "0000xxxx", 2));
+    buffer.addRule(rule_info(2, "1111xxxx", 2));
+    EXPECT_EQ(3u, buffer.droppedOperations());
+
+    auto operations = buffer.popOperations();
+    EXPECT_TRUE(buffer.empty());
+    ASSERT_EQ(3u, operations.size());
+    EXPECT_EQ(RuleOperationType::ADD_OR_MODIFY, operations[0].type);
+    EXPECT_EQ(4u, operations[0].info.actions.port_actions.begin()->port_id);
+    EXPECT_EQ(RuleOperationType::MODIFY, operations[1].type);
+    EXPECT_EQ(RuleOperationType::ADD, operations[2].type);
+
+    // Deletion drops the pending rules it removes, but not the later ones
+    buffer.addRule(rule_info(2, "00001111", 2));
+    buffer.changeRule(rule_info(1, "00001111", 2));
+    buffer.addRule(rule_info(2, "11111111", 2));
+    buffer.deleteRule(rule_info(0, "0000xxxx", 1));
+    buffer.addRule(rule_info(2, "00001111", 3));
+    EXPECT_EQ(5u, buffer.droppedOperations());
+
+    operations = buffer.popOperations();
+    ASSERT_EQ(3u, operations.size());
+    EXPECT_EQ(RuleOperationType::ADD, operations[0].type);
+    EXPECT_TRUE(M(1, B("11111111")) == operations[0].info.match);
+    EXPECT_EQ(RuleOperationType::DELETE, operations[1].type);
+    EXPECT_EQ(RuleOperationType::ADD, operations[2].type);
+    EXPECT_TRUE(M(1, B("00001111")) == operations[2].info.match);
+}
+
+TEST(RuleOperationBufferTest, CutTest)
+{
+    using B = BitMask;
+    using M = Match;
+    auto rule_info = [](Priority priority, PortId out_port) {
+        return RuleInfo(1, 0, priority, 0x0, M(1, B("0000xxxx")),
+                        ActionsBase::portAction(out_port));
+    };
+
+    RuleOperationBuffer buffer;
+    buffer.addRule(rule_info(2, 2));
+    auto first_bound = buffer.cut();
+    // Updates after a cut are not merged with the earlier ones
+    buffer.changeRule(rule_info(2, 3));
+    buffer.deleteRule(rule_info(2, 3));
+    auto second_bound = buffer.cut();
+    buffer.addRule(rule_info(1, 2));
+    EXPECT_EQ(1u, buffer.droppedOperations());
+
+    auto operations = buffer.popOperations(first_bound);
+    ASSERT_EQ(1u, operations.size());
+    EXPECT_EQ(RuleOperationType::ADD, operations[0].type);
+    EXPECT_EQ(2u, operations[0].info.actions.port_actions.begin()->port_id);
+
+    operations = buffer.popOperations(second_bound);
+    ASSERT_EQ(1u, operations.size());
+    EXPECT_EQ(RuleOperationType::DELETE, operations[0].type);
+    EXPECT_FALSE(buffer.empty());
+
+    operations = buffer.popOperations();
+    ASSERT_EQ(1u, operations.size());
+    EXPECT_EQ(1u, operations[0].info.priority);
+    EXPECT_TRUE(buffer.empty());
+}
+
+TEST(RuleSlabTest, HandleTest)
+{
+    auto make_rule = []() {
+        return makeRule(RuleType::SINK, nullptr, nullptr, LOW_PRIORITY,
+                        ZERO_COOKIE, NetworkSpace::wholeSpace(),
+                        Actions::noActions());
+    };
+    auto& slab = RuleSlab::instance();
+    auto size = slab.size();
+    EXPECT_EQ(4u, sizeof(RulePtr));
+
+    auto rule = make_rule();
+    EXPECT_EQ(size + 1u, slab.size());
+    {
+        // Copies refer to the same rule
+        auto copy = rule;
+        EXPECT_EQ(rule, copy);
+        EXPECT_EQ(rule.get(), copy.get());
+    }
+    EXPECT_EQ(size + 1u, slab.size());
+
+    // Released slot is reused by the next rule
+    auto index = rule.index();
+    rule = nullptr;
+    EXPECT_EQ(nullptr, rule);
+    EXPECT_EQ(size, slab.size());
+    rule = make_rule();
+    EXPECT_EQ(index, rule.index());
+}
@@ -0,0 +1,30 @@
+#include "gtest/gtest.h"
+
+#include "../../src/Types.hpp"
+
+#include <vector>
+
+TEST(QueueWithBarriersTest, BarrierTest)
+{
+    QueueWithBarriers<int> queue;
+    queue.push(1);
+    queue.push(2);
+    queue.addBarrier();
+    queue.push(3);
+    ASSERT_EQ(2u, queue.size());
+    EXPECT_EQ(std::vector<int>({1, 2}), queue.pop());
+    EXPECT_EQ(std::vector<int>({3}), queue.pop());
+    EXPECT_TRUE(queue.empty());
+}
+
+TEST(QueueWithBarriersTest, EmptyQueueBarrierTest)
+{
+    // Elements pushed after the barrier wait for the second flush
+    QueueWithBarriers<int> queue;
+    queue.addBarrier();
+    queue.push(1);
+    ASSERT_EQ(2u, queue.size());
+    EXPECT_TRUE(queue.pop().empty());
+    EXPECT_EQ(std::vector<int>({1}), queue.pop());
+    EXPECT_TRUE(queue.empty());
+}